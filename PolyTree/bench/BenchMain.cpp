@@ -0,0 +1,616 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Benchmark.h"
+#include "BspCollide.h"
+#include "BspStream.h"
+#include "BspTree.h"
+#include "MemTrack.h"
+#include "MeshGen.h"
+#include "Trace.h"
+
+// polytree-bench: micro and macro benchmarks over the sample objects and generated meshes.
+//
+//   --objects=<dir>     where the sample OBJs live, objects/ by default
+//   --max_tris=<n>      skip generated meshes bigger than this, 10M by default
+//   --kinds=<a,b,..>    which generated meshes to use, soup and grid by default, or all
+//   --tmp=<dir>         scratch space for the parse, export and out of core build benchmarks
+//   --trace=<file>      record a Chrome trace of the whole run
+//
+// plus the usual --benchmark_filter, --benchmark_min_time and --benchmark_out=<file.json>
+
+#define RAY_COUNT 4096
+#define POINT_COUNT 4096
+
+struct BenchMesh
+{
+	std::string name;
+	std::string path;		// empty for generated meshes
+	MeshGen gen;
+
+	Obj o;
+	bool loaded;
+
+	std::unique_ptr<BspTree> tree;
+	std::unique_ptr<BspCollide> collide;
+};
+
+struct BspHeuristic
+{
+	const char* name;
+	int candidates, samples, penalty;
+};
+
+static const BspHeuristic heuristics[] =
+{
+	{ "Balanced", 16, 1024, 8 },
+	{ "SplitAverse", 16, 1024, 64 },
+	{ "Wide", 64, 1024, 8 }
+};
+
+static std::vector<std::unique_ptr<BenchMesh> > meshes;
+static std::string tmpDir = ".";
+
+static uint32_t NextRandom(uint32_t& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 8;
+}
+
+static float RandomFloat(uint32_t& seed)
+{
+	return (NextRandom(seed) & 0xFFFF) / 65535.0f;
+}
+
+static long long FileSize(const char* path)
+{
+	FILE* f = fopen(path, "rb");
+
+	if (!f)
+	{
+		return -1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long long size = ftell(f);
+	fclose(f);
+	return size;
+}
+
+static Obj LoadObj(std::string& path)
+{
+	MemScope mem(MEM_LOADER);
+	Obj o = loadObj(&path[0]);
+
+	MemTrack::Add(MEM_LOADER, ObjBytes(o));
+	return o;
+}
+
+static void FreeObj(Obj& o)
+{
+	MemTrack::Sub(MEM_LOADER, ObjBytes(o));
+	free(o.verts);
+	free(o.indices);
+	memset(&o, 0, sizeof(o));
+}
+
+// Only one mesh is kept in memory at a time, the benchmarks being registered mesh by mesh
+static void Release(BenchMesh& mesh)
+{
+	if (mesh.loaded && !mesh.path.empty())
+	{
+		FreeObj(mesh.o);
+	}
+
+	mesh.gen.Clear();
+	mesh.tree.reset();
+	mesh.collide.reset();
+	mesh.loaded = false;
+}
+
+static Obj& Acquire(BenchMesh& mesh)
+{
+	if (!mesh.loaded)
+	{
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			if (meshes[i].get() != &mesh)
+			{
+				Release(*meshes[i]);
+			}
+		}
+
+		if (!mesh.path.empty())
+		{
+			mesh.o = LoadObj(mesh.path);
+		}
+		else
+		{
+			mesh.gen.Generate(mesh.o);
+		}
+
+		mesh.loaded = true;
+	}
+
+	return mesh.o;
+}
+
+static BspTree& Tree(BenchMesh& mesh)
+{
+	Obj& o = Acquire(mesh);
+
+	if (!mesh.tree)
+	{
+		mesh.tree.reset(new BspTree());
+		mesh.tree->Build(o);
+	}
+
+	return *mesh.tree;
+}
+
+static BspCollide& Collide(BenchMesh& mesh)
+{
+	BspTree& tree = Tree(mesh);
+
+	if (!mesh.collide)
+	{
+		mesh.collide.reset(new BspCollide());
+		mesh.collide->Build(tree);
+	}
+
+	return *mesh.collide;
+}
+
+static void Bounds(const BspTree& tree, float* mn, float* mx)
+{
+	const BspBounds& b = tree.nodes[0].bounds;
+
+	mn[0] = b.min.x / 65536.0f;
+	mn[1] = b.min.y / 65536.0f;
+	mn[2] = b.min.z / 65536.0f;
+	mx[0] = b.max.x / 65536.0f;
+	mx[1] = b.max.y / 65536.0f;
+	mx[2] = b.max.z / 65536.0f;
+}
+
+// The whole file with loadObj, or pulled through BspObjStream a batch at a time as the
+// out of core build would
+static void BenchParse(BenchState& state, BenchMesh* mesh, bool stream)
+{
+	std::string path = mesh->path;
+
+	// Generated meshes get written out once so there's something to parse
+	if (path.empty())
+	{
+		path = tmpDir + "/polytree-bench.obj";
+
+		if (!mesh->gen.Write(path.c_str()))
+		{
+			state.SkipWithError("couldn't write the generated mesh");
+			return;
+		}
+	}
+
+	long long size = FileSize(path.c_str());
+
+	std::vector<BspTri> batch(4096);
+
+	while (state.KeepRunning())
+	{
+		if (stream)
+		{
+			BspObjStream reader;
+
+			if (!reader.Open(path.c_str()))
+			{
+				state.SkipWithError("couldn't open the mesh");
+				break;
+			}
+
+			while (reader.Read(batch.data(), (int)batch.size()) > 0)
+			{
+			}
+		}
+		else
+		{
+			Obj o = LoadObj(path);
+			FreeObj(o);
+		}
+	}
+
+	if (mesh->path.empty())
+	{
+		remove(path.c_str());
+	}
+
+	state.SetBytesProcessed(size * state.Iterations());
+}
+
+static void BenchGenerate(BenchState& state, BenchMesh* mesh)
+{
+	MeshGen gen;
+	Obj o;
+
+	// Nothing else needs to be held while this runs
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		Release(*meshes[i]);
+	}
+
+	gen.kind = mesh->gen.kind;
+	gen.triCount = mesh->gen.triCount;
+	gen.seed = mesh->gen.seed;
+
+	while (state.KeepRunning())
+	{
+		gen.Generate(o);
+	}
+
+	state.SetItemsProcessed(gen.trisMade * state.Iterations());
+}
+
+static void BenchConvert(BenchState& state, BenchMesh* mesh)
+{
+	BspTree& tree = Tree(*mesh);
+	std::vector<float> out(tree.verts.size() * 3);
+
+	while (state.KeepRunning())
+	{
+		BspTree::ToFloat(tree.verts.data(), tree.verts.size(), out.data());
+	}
+
+	state.SetBytesProcessed((int64_t)(tree.verts.size() * sizeof(BspVec)) * state.Iterations());
+	state.SetItemsProcessed((int64_t)tree.verts.size() * state.Iterations());
+}
+
+static void BenchBuild(BenchState& state, BenchMesh* mesh, const BspHeuristic* heuristic)
+{
+	Obj& o = Acquire(*mesh);
+	BspTree tree;
+
+	tree.splitterCandidates = heuristic->candidates;
+	tree.splitterSamples = heuristic->samples;
+	tree.splitPenalty = heuristic->penalty;
+
+	long long before = MemTrack::Stats(MEM_BSP).current;
+	MemTrack::Mark();
+
+	while (state.KeepRunning())
+	{
+		tree.Build(o);
+	}
+
+	state.SetItemsProcessed((int64_t)(o.indexCount / 3) * state.Iterations());
+	state.counters["nodes"] = (double)tree.nodes.size();
+	state.counters["splits"] = (double)tree.splitCount;
+	state.counters["peak_mb"] = (MemTrack::Stats(MEM_BSP).markPeak - before) / (1024.0 * 1024.0);
+	state.counters["kept_mb"] = (MemTrack::Stats(MEM_BSP).current - before) / (1024.0 * 1024.0);
+}
+
+// Out of core, with an eighth of the memory an in-core build wants so there's something to spill
+static void BenchStreamBuild(BenchState& state, BenchMesh* mesh)
+{
+	Obj& o = Acquire(*mesh);
+	BspStreamBuilder stream;
+	BspTree tree;
+
+	stream.memoryBudget = (long long)(o.indexCount / 3) * BSP_STREAM_TRI_BYTES / 8;
+	stream.tmpDir = tmpDir;
+
+	long long before = MemTrack::Stats(MEM_BSP).current;
+	MemTrack::Mark();
+
+	while (state.KeepRunning())
+	{
+		BspObjSource source(o, false);
+
+		if (!stream.Build(tree, source))
+		{
+			state.SkipWithError("stream build failed");
+			return;
+		}
+	}
+
+	state.SetItemsProcessed((int64_t)(o.indexCount / 3) * state.Iterations());
+	state.counters["nodes"] = (double)tree.nodes.size();
+	state.counters["buckets"] = (double)stream.buckets;
+	state.counters["spilled_mb"] = stream.bytesSpilled / (1024.0 * 1024.0);
+	state.counters["peak_mb"] = (MemTrack::Stats(MEM_BSP).markPeak - before) / (1024.0 * 1024.0);
+	state.counters["kept_mb"] = (MemTrack::Stats(MEM_BSP).current - before) / (1024.0 * 1024.0);
+}
+
+static void BenchCull(BenchState& state, BenchMesh* mesh)
+{
+	BspTree& tree = Tree(*mesh);
+	std::vector<BspRange> ranges;
+	BspCullStats stats;
+	float mn[3], mx[3];
+
+	if (tree.nodes.empty())
+	{
+		state.SkipWithError("no nodes");
+		return;
+	}
+
+	// Looking down at the middle from outside one corner, so some of it's off screen
+	Bounds(tree, mn, mx);
+
+	glm::vec3 center((mn[0] + mx[0]) * 0.5f, (mn[1] + mx[1]) * 0.5f, (mn[2] + mx[2]) * 0.5f);
+	glm::vec3 eye = center + glm::vec3(mx[0] - mn[0], mx[1] - mn[1], mx[2] - mn[2]) * 0.6f;
+	glm::mat4 mvp = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 10000.0f) * glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+	BspFrustum frustum(&mvp[0][0]);
+	BspVec eyeFixed = { (fix16)(eye.x * 65536.0f), (fix16)(eye.y * 65536.0f), (fix16)(eye.z * 65536.0f) };
+
+	while (state.KeepRunning())
+	{
+		ranges.clear();
+		memset(&stats, 0, sizeof(stats));
+		tree.CollectVisible(frustum, eyeFixed, true, true, NULL, ranges, stats);
+	}
+
+	state.SetItemsProcessed(state.Iterations());
+	state.counters["nodesVisited"] = stats.nodesVisited;
+	state.counters["trisDrawn"] = stats.trisDrawn;
+}
+
+static void BenchFindLeaf(BenchState& state, BenchMesh* mesh)
+{
+	BspTree& tree = Tree(*mesh);
+	std::vector<BspVec> points(POINT_COUNT);
+	uint32_t seed = 1;
+	float mn[3], mx[3];
+	int sum = 0;
+
+	if (tree.nodes.empty())
+	{
+		state.SkipWithError("no nodes");
+		return;
+	}
+
+	Bounds(tree, mn, mx);
+
+	for (int i = 0; i < POINT_COUNT; i++)
+	{
+		points[i].x = (fix16)((mn[0] + (mx[0] - mn[0]) * RandomFloat(seed)) * 65536.0f);
+		points[i].y = (fix16)((mn[1] + (mx[1] - mn[1]) * RandomFloat(seed)) * 65536.0f);
+		points[i].z = (fix16)((mn[2] + (mx[2] - mn[2]) * RandomFloat(seed)) * 65536.0f);
+	}
+
+	while (state.KeepRunning())
+	{
+		for (int i = 0; i < POINT_COUNT; i++)
+		{
+			sum += tree.FindLeaf(points[i]);
+		}
+	}
+
+	state.SetItemsProcessed((int64_t)POINT_COUNT * state.Iterations());
+	state.counters["leafSum"] = (double)(sum & 0xFFFF);
+}
+
+static void BenchRay(BenchState& state, BenchMesh* mesh, bool batch)
+{
+	BspTree& tree = Tree(*mesh);
+	BspCollide& collide = Collide(*mesh);
+	std::vector<BspRay> rays(RAY_COUNT);
+	std::vector<BspHit> hits(RAY_COUNT);
+	uint32_t seed = 2;
+	float mn[3], mx[3];
+	int hitCount = 0;
+
+	if (tree.nodes.empty())
+	{
+		state.SkipWithError("no nodes");
+		return;
+	}
+
+	Bounds(tree, mn, mx);
+
+	for (int i = 0; i < RAY_COUNT; i++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			rays[i].start[a] = mn[a] + (mx[a] - mn[a]) * RandomFloat(seed);
+			rays[i].end[a] = mn[a] + (mx[a] - mn[a]) * RandomFloat(seed);
+		}
+	}
+
+	while (state.KeepRunning())
+	{
+		if (batch)
+		{
+			collide.TraceBatch(rays.data(), RAY_COUNT, 0.0f, hits.data());
+			continue;
+		}
+
+		hitCount = 0;
+
+		for (int i = 0; i < RAY_COUNT; i++)
+		{
+			hitCount += collide.Trace(rays[i].start, rays[i].end, 0.0f, hits[i]);
+		}
+	}
+
+	state.SetItemsProcessed((int64_t)RAY_COUNT * state.Iterations());
+
+	if (!batch)
+	{
+		state.counters["hitRate"] = hitCount / (double)RAY_COUNT;
+	}
+}
+
+static void BenchExport(BenchState& state, BenchMesh* mesh)
+{
+	BspTree& tree = Tree(*mesh);
+	std::string path = tmpDir + "/polytree-bench.bsp";
+
+	while (state.KeepRunning())
+	{
+		if (!tree.Export(path.c_str()))
+		{
+			state.SkipWithError("couldn't write the export");
+			return;
+		}
+	}
+
+	state.SetBytesProcessed(FileSize(path.c_str()) * state.Iterations());
+	remove(path.c_str());
+}
+
+static BenchMesh* AddMesh(const std::string& name, const std::string& path)
+{
+	BenchMesh* mesh = new BenchMesh();
+
+	mesh->name = name;
+	mesh->path = path;
+	mesh->loaded = false;
+	meshes.push_back(std::unique_ptr<BenchMesh>(mesh));
+	return mesh;
+}
+
+static void RegisterMesh(BenchMesh* mesh)
+{
+	const std::string& name = mesh->name;
+
+	if (mesh->path.empty())
+	{
+		RegisterBenchmark("Generate/" + name, [mesh](BenchState& state) { BenchGenerate(state, mesh); });
+	}
+
+	RegisterBenchmark("ObjParse/" + name, [mesh](BenchState& state) { BenchParse(state, mesh, false); });
+	RegisterBenchmark("ObjStream/" + name, [mesh](BenchState& state) { BenchParse(state, mesh, true); });
+	RegisterBenchmark("FixedToFloat/" + name, [mesh](BenchState& state) { BenchConvert(state, mesh); });
+
+	for (size_t h = 0; h < sizeof(heuristics) / sizeof(heuristics[0]); h++)
+	{
+		const BspHeuristic* heuristic = &heuristics[h];
+		RegisterBenchmark(std::string("BspBuild/") + heuristic->name + "/" + name, [mesh, heuristic](BenchState& state) { BenchBuild(state, mesh, heuristic); });
+	}
+
+	RegisterBenchmark("BspStream/" + name, [mesh](BenchState& state) { BenchStreamBuild(state, mesh); });
+	RegisterBenchmark("Cull/" + name, [mesh](BenchState& state) { BenchCull(state, mesh); });
+	RegisterBenchmark("FindLeaf/" + name, [mesh](BenchState& state) { BenchFindLeaf(state, mesh); });
+	RegisterBenchmark("Trace/" + name, [mesh](BenchState& state) { BenchRay(state, mesh, false); });
+	RegisterBenchmark("TraceBatch/" + name, [mesh](BenchState& state) { BenchRay(state, mesh, true); });
+	RegisterBenchmark("Export/" + name, [mesh](BenchState& state) { BenchExport(state, mesh); });
+}
+
+int main(int argc, char** argv)
+{
+	const char* samples[] = { "ACE.OBJ", "CUBE.OBJ", "MONKEY.OBJ" };
+	const int sizes[] = { 10000, 100000, 1000000, 10000000 };
+	std::string objects = "objects";
+	long long maxTris = 10000000;
+	std::string kinds = "soup,grid";
+	const char* trace = NULL;
+	bool list = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "--objects=", 10))
+		{
+			objects = argv[i] + 10;
+		}
+		else if (!strncmp(argv[i], "--max_tris=", 11))
+		{
+			maxTris = atoll(argv[i] + 11);
+		}
+		else if (!strncmp(argv[i], "--kinds=", 8))
+		{
+			kinds = argv[i] + 8;
+		}
+		else if (!strncmp(argv[i], "--tmp=", 6))
+		{
+			tmpDir = argv[i] + 6;
+		}
+		else if (!strncmp(argv[i], "--trace=", 8))
+		{
+			trace = argv[i] + 8;
+		}
+		else if (!strcmp(argv[i], "--benchmark_list_tests"))
+		{
+			list = true;
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+	{
+		std::string path = objects + "/" + samples[i];
+
+		if (FileSize(path.c_str()) < 0)
+		{
+			fprintf(stderr, "Skipping %s, it's not there\n", path.c_str());
+			continue;
+		}
+
+		AddMesh(samples[i], path);
+	}
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		if (sizes[i] > maxTris)
+		{
+			continue;
+		}
+
+		for (int k = 0; k < MESHGEN_KIND_COUNT; k++)
+		{
+			const char* kind = MeshGen::KindName((MeshGenKind)k);
+
+			if (kinds != "all" && ("," + kinds + ",").find(std::string(",") + kind + ",") == std::string::npos)
+			{
+				continue;
+			}
+
+			BenchMesh* mesh = AddMesh(std::string(kind) + "/" + std::to_string(sizes[i]), "");
+			mesh->gen.kind = (MeshGenKind)k;
+			mesh->gen.triCount = sizes[i];
+		}
+	}
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		RegisterMesh(meshes[i].get());
+	}
+
+	if (trace)
+	{
+		Trace::SetThreadName("Main");
+		Trace::Start();
+	}
+
+	int result = RunBenchmarks(argc, argv);
+
+	if (!list)
+	{
+		printf("\n");
+		MemTrack::Report(stdout);
+	}
+
+	if (!trace)
+	{
+		return result;
+	}
+
+	Trace::Stop();
+
+	if (!Trace::Save(trace))
+	{
+		fprintf(stderr, "Failed to write %s\n", trace);
+		return 1;
+	}
+
+	if (Trace::DroppedCount())
+	{
+		fprintf(stderr, "%lld trace events didn't fit and were dropped\n", Trace::DroppedCount());
+	}
+
+	return result;
+}
@@ -0,0 +1,359 @@
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <regex>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#define MAX_ITERATIONS 1000000000LL
+#define MAX_GROWTH 10.0
+
+struct BenchEntry
+{
+	std::string name;
+	BenchFunction function;
+	int64_t iterations;
+};
+
+struct BenchResult
+{
+	std::string name;
+	int64_t iterations;
+	double realSeconds, cpuSeconds;		// per iteration
+	double bytesPerSecond, itemsPerSecond;
+	std::map<std::string, double> counters;
+	std::string error;
+};
+
+static std::vector<BenchEntry>& Registry()
+{
+	static std::vector<BenchEntry> entries;
+	return entries;
+}
+
+// clock() is wall time under MSVC, so ask for the process times directly there
+static double CpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+
+	if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+	{
+		return 0.0;
+	}
+
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void Unit(double seconds, const char*& unit, double& scale)
+{
+	if (seconds < 1e-5)
+	{
+		unit = "ns";
+		scale = 1e9;
+	}
+	else if (seconds < 1e-2)
+	{
+		unit = "us";
+		scale = 1e6;
+	}
+	else
+	{
+		unit = "ms";
+		scale = 1e3;
+	}
+}
+
+static std::string Escape(const std::string& s)
+{
+	std::string out;
+
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		if (s[i] == '"' || s[i] == '\\')
+		{
+			out += '\\';
+		}
+
+		out += s[i];
+	}
+
+	return out;
+}
+
+BenchState::BenchState(int64_t iterations)
+{
+	maxIterations = iterations;
+	done = 0;
+	bytesProcessed = itemsProcessed = 0;
+	running = false;
+	seconds = 0.0;
+	cpuStart = cpuSeconds = 0.0;
+}
+
+bool BenchState::KeepRunning()
+{
+	if (!running && done == 0)
+	{
+		ResumeTiming();
+	}
+
+	if (done < maxIterations && error.empty())
+	{
+		done++;
+		return true;
+	}
+
+	if (running)
+	{
+		PauseTiming();
+	}
+
+	return false;
+}
+
+void BenchState::PauseTiming()
+{
+	seconds += std::chrono::duration<double>(Clock::now() - start).count();
+	cpuSeconds += CpuSeconds() - cpuStart;
+	running = false;
+}
+
+void BenchState::ResumeTiming()
+{
+	running = true;
+	cpuStart = CpuSeconds();
+	start = Clock::now();
+}
+
+class BenchRunner
+{
+public:
+	static bool Run(const BenchEntry& entry, double minTime, BenchResult& result)
+	{
+		int64_t iterations = entry.iterations ? entry.iterations : 1;
+
+		result.name = entry.name;
+
+		for (;;)
+		{
+			BenchState state(iterations);
+
+			entry.function(state);
+
+			if (!state.error.empty())
+			{
+				result.error = state.error;
+				return false;
+			}
+
+			if (entry.iterations || state.seconds >= minTime || iterations >= MAX_ITERATIONS)
+			{
+				result.iterations = state.done;
+				result.realSeconds = state.seconds / state.done;
+				result.cpuSeconds = state.cpuSeconds / state.done;
+				result.bytesPerSecond = state.seconds > 0.0 ? state.bytesProcessed / state.seconds : 0.0;
+				result.itemsPerSecond = state.seconds > 0.0 ? state.itemsProcessed / state.seconds : 0.0;
+				result.counters = state.counters;
+				return true;
+			}
+
+			// Aim a little past the minimum so the next run is very likely the last
+			double growth = state.seconds > 0.0 ? minTime * 1.4 / state.seconds : MAX_GROWTH;
+			growth = growth < MAX_GROWTH ? growth : MAX_GROWTH;
+
+			int64_t next = (int64_t)(iterations * growth);
+			iterations = next > iterations ? next : iterations + 1;
+		}
+	}
+};
+
+void RegisterBenchmark(const std::string& name, BenchFunction function, int64_t iterations)
+{
+	BenchEntry entry = { name, function, iterations };
+	Registry().push_back(entry);
+}
+
+static void PrintResult(const BenchResult& r)
+{
+	if (!r.error.empty())
+	{
+		printf("%-48s ERROR: %s\n", r.name.c_str(), r.error.c_str());
+		return;
+	}
+
+	const char* unit;
+	double scale;
+
+	Unit(r.realSeconds, unit, scale);
+	printf("%-48s %12.3f %s %12.3f %s %10lld", r.name.c_str(), r.realSeconds * scale, unit, r.cpuSeconds * scale, unit, (long long)r.iterations);
+
+	if (r.bytesPerSecond > 0.0)
+	{
+		printf(" %9.2f MB/s", r.bytesPerSecond / (1024.0 * 1024.0));
+	}
+
+	if (r.itemsPerSecond > 0.0)
+	{
+		printf(" %10.4g items/s", r.itemsPerSecond);
+	}
+
+	for (std::map<std::string, double>::const_iterator it = r.counters.begin(); it != r.counters.end(); ++it)
+	{
+		printf(" %s=%g", it->first.c_str(), it->second);
+	}
+
+	printf("\n");
+	fflush(stdout);
+}
+
+static bool WriteJson(const char* path, const char* executable, const std::vector<BenchResult>& results)
+{
+	FILE* f = fopen(path, "w");
+	char date[64];
+	time_t now = time(NULL);
+
+	if (!f)
+	{
+		return false;
+	}
+
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	fprintf(f, "{\n  \"context\": {\n");
+	fprintf(f, "    \"date\": \"%s\",\n", date);
+	fprintf(f, "    \"executable\": \"%s\",\n", Escape(executable).c_str());
+	fprintf(f, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+	fprintf(f, "    \"library_build_type\": \"release\"\n");
+#else
+	fprintf(f, "    \"library_build_type\": \"debug\"\n");
+#endif
+	fprintf(f, "  },\n  \"benchmarks\": [");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& r = results[i];
+		std::string name = Escape(r.name);
+
+		fprintf(f, "%s\n    {\n", i ? "," : "");
+		fprintf(f, "      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n      \"run_type\": \"iteration\",\n", name.c_str(), name.c_str());
+
+		if (!r.error.empty())
+		{
+			fprintf(f, "      \"error_occurred\": true,\n      \"error_message\": \"%s\"\n    }", Escape(r.error).c_str());
+			continue;
+		}
+
+		const char* unit;
+		double scale;
+
+		Unit(r.realSeconds, unit, scale);
+		fprintf(f, "      \"iterations\": %lld,\n", (long long)r.iterations);
+		fprintf(f, "      \"real_time\": %.6f,\n      \"cpu_time\": %.6f,\n      \"time_unit\": \"%s\"", r.realSeconds * scale, r.cpuSeconds * scale, unit);
+
+		if (r.bytesPerSecond > 0.0)
+		{
+			fprintf(f, ",\n      \"bytes_per_second\": %.6f", r.bytesPerSecond);
+		}
+
+		if (r.itemsPerSecond > 0.0)
+		{
+			fprintf(f, ",\n      \"items_per_second\": %.6f", r.itemsPerSecond);
+		}
+
+		for (std::map<std::string, double>::const_iterator it = r.counters.begin(); it != r.counters.end(); ++it)
+		{
+			fprintf(f, ",\n      \"%s\": %.6f", Escape(it->first).c_str(), it->second);
+		}
+
+		fprintf(f, "\n    }");
+	}
+
+	fprintf(f, "\n  ]\n}\n");
+	fclose(f);
+	return true;
+}
+
+int RunBenchmarks(int argc, char** argv)
+{
+	const char* filter = ".";
+	const char* out = NULL;
+	double minTime = 0.5;
+	bool list = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "--benchmark_filter=", 19))
+		{
+			filter = argv[i] + 19;
+		}
+		else if (!strncmp(argv[i], "--benchmark_min_time=", 21))
+		{
+			minTime = atof(argv[i] + 21);
+		}
+		else if (!strncmp(argv[i], "--benchmark_out=", 16))
+		{
+			out = argv[i] + 16;
+		}
+		else if (!strcmp(argv[i], "--benchmark_list_tests"))
+		{
+			list = true;
+		}
+	}
+
+	std::regex pattern(filter);
+	std::vector<BenchResult> results;
+	bool failed = false;
+
+	if (!list)
+	{
+		printf("%-48s %15s %15s %10s\n", "Benchmark", "Time", "CPU", "Iterations");
+	}
+
+	for (size_t i = 0; i < Registry().size(); i++)
+	{
+		const BenchEntry& entry = Registry()[i];
+
+		if (!std::regex_search(entry.name, pattern))
+		{
+			continue;
+		}
+
+		if (list)
+		{
+			printf("%s\n", entry.name.c_str());
+			continue;
+		}
+
+		BenchResult result;
+
+		failed |= !BenchRunner::Run(entry, minTime, result);
+		PrintResult(result);
+		results.push_back(result);
+	}
+
+	if (out && !WriteJson(out, argv[0], results))
+	{
+		fprintf(stderr, "Failed to write %s\n", out);
+		return 1;
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// A small stand-in for Google Benchmark: benchmarks are registered by name, each one loops over
+// its timed section while KeepRunning returns true, and the runner picks an iteration count that
+// fills the minimum time. Results print as a table and can be written out in Google Benchmark's
+// JSON format so existing comparison tools work on them.
+class BenchState
+{
+public:
+	std::map<std::string, double> counters;
+
+	BenchState(int64_t iterations);
+
+	bool KeepRunning();
+
+	// Leave setup that has to happen every iteration out of the timing
+	void PauseTiming();
+	void ResumeTiming();
+
+	void SetBytesProcessed(int64_t bytes) { bytesProcessed = bytes; }
+	void SetItemsProcessed(int64_t items) { itemsProcessed = items; }
+	void SkipWithError(const char* message) { error = message; }
+
+	int64_t Iterations() const { return maxIterations; }
+
+private:
+	friend class BenchRunner;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	int64_t maxIterations, done;
+	int64_t bytesProcessed, itemsProcessed;
+	bool running;
+	Clock::time_point start;
+	double seconds;
+	double cpuStart, cpuSeconds;
+	std::string error;
+};
+
+typedef std::function<void(BenchState&)> BenchFunction;
+
+// Benchmarks with a fixed iteration count run exactly that many times, for the ones too slow to
+// repeat until the minimum time is up
+void RegisterBenchmark(const std::string& name, BenchFunction function, int64_t iterations = 0);
+
+// Handles --benchmark_filter=<regex>, --benchmark_min_time=<seconds>, --benchmark_out=<file>
+// and --benchmark_list_tests, returning the process exit code
+int RunBenchmarks(int argc, char** argv);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every file with a given extension under a root directory, found and indexed on a background
+// thread. Queries are space separated terms that all have to appear somewhere in the path, case
+// insensitive. Each term's trigrams narrow things down to a handful of candidates before any
+// strings get compared, so a query over hundreds of thousands of paths takes a millisecond or so.
+class AssetIndex
+{
+public:
+	double buildSeconds;
+	double querySeconds;
+
+	AssetIndex();
+	~AssetIndex();
+
+	// Starts indexing, abandoning any build already running. The old index stays queryable
+	// until the new one is ready.
+	void Build(const char* root, const char* extension);
+	void Cancel() { cancelled = true; }
+
+	// Call once a frame. Swaps the new index in once it's built, returning true when it does.
+	bool Update();
+
+	bool Building() const { return running; }
+	int FilesFound() const { return found; }
+
+	int PathCount() const { return index ? (int)index->paths.size() : 0; }
+	const std::string& Path(int i) const { return index->paths[i]; }
+	const std::string& Root() const { return index->root; }
+
+	// Fills out with up to maxResults paths, best first, returning how many matched in all
+	int Query(const char* text, int maxResults, std::vector<int>& out);
+
+private:
+	struct Index
+	{
+		std::string root;
+		std::vector<std::string> paths;		// relative to the root
+		std::vector<std::string> lower;
+
+		// Trigram postings, the paths containing trigrams[i] being ids[offsets[i]] to ids[offsets[i + 1]]
+		std::vector<uint32_t> trigrams;
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> ids;
+	};
+
+	std::unique_ptr<Index> index;
+	std::unique_ptr<Index> built;
+	std::thread worker;
+	std::atomic<bool> finished, cancelled;
+	std::atomic<int> found;
+	bool running;
+
+	std::vector<uint32_t> candidates, scratch;
+
+	void Join();
+	void BuildIndex(std::string root, std::string extension);
+	bool Walk(const std::string& root, const std::string& dir, const std::string& extension, Index& out);
+	bool Postings(uint32_t trigram, const uint32_t*& first, const uint32_t*& last) const;
+};
@@ -1,19 +1,63 @@
 #pragma once
 
+#include <vector>
+
+#include <glm/glm.hpp>
+
 extern "C"
 {
 	#include "Obj.h"
 }
 
+#include "BspTree.h"
+#include "BspPortals.h"
+#include "BspVis.h"
+#include "BspCollide.h"
+#include "BspLight.h"
+#include "BuildProgress.h"
+#include "MeshBuffer.h"
+
 class AtariObj
 {
 public:
 	Obj o;
+	BspTree bsp;
+	BspPortals portals;
+	BspVis vis;
+	BspCollide collide;
+	BspLight light;
+
+	bool frustumCull, backfaceCull, pvsCull;
+	bool showLighting;
+	int eyeLeaf;
+	BspCullStats cullStats;
+	BspRayBench rayBench;
 	
-	AtariObj(char* filename);
-	void Render();
+	// Where the scene's shared buffers keep this mesh
+	MeshSlot slot;
+	bool lightChanged;
+
+	AtariObj();
+	~AtariObj();
+
+	// Loads and compiles the model, which can take a while on big ones so it's safe to run on a
+	// worker thread. Portals and vis are only built if asked for, as they can take far longer
+	// than everything else put together. Returns false if progress was cancelled part way through.
+	bool Load(char* filename, bool buildVis, BuildProgress* progress = NULL);
+
+	// Culls against the camera, eye being in object space, leaving what's left in VisibleRanges
+	void Cull(const glm::mat4& mvp, const glm::vec3& eye);
+	const std::vector<BspRange>& VisibleRanges() const { return ranges; }
+
+	// Bakes on whatever thread calls it, which can be a worker as the tree is only read. The result
+	// is held back until ApplyLighting hands it over on the thread that draws. Returns false if
+	// progress was cancelled part way through.
+	bool BakeLighting(BuildProgress* progress = NULL);
+	void ApplyLighting();
 
 private:
-	unsigned int VAO, VBO, EBO;
-	void SetupBuffers();
+	std::vector<BspRange> ranges;
+	std::vector<unsigned char> nodeVis;
+	int nodeVisLeaf;
+	std::vector<unsigned char> bakedLight;
 };
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+
+#include "BspTree.h"
+
+struct BspRay
+{
+	float start[3];
+	float end[3];
+};
+
+struct BspHit
+{
+	float fraction;		// along the segment, 1 if nothing was hit
+	float normal[3];
+	bool startSolid;
+};
+
+struct BspHitFixed
+{
+	fix16 fraction;
+	int plane;			// index into the tree's planes, -1 if nothing was hit or we started in solid
+	bool flipped;		// hit the back of the plane
+	bool startSolid;
+};
+
+struct BspRayBench
+{
+	int rays;
+	int hits;
+	double floatMRays, fixedMRays, batchMRays;
+	double coherentMRays, packetMRays;		// single and packet traces over bundles of similar rays
+};
+
+// Point and swept queries against the solid leaves of a compiled tree. Segments and rays are a
+// sphere of radius zero; larger spheres push the node planes out by the radius, which is exact
+// on faces and a little generous around sharp edges.
+class BspCollide
+{
+public:
+	int threadCount;
+
+	// Sort batches so rays starting close together walk the tree together. Only pays off on
+	// trees too big for the cache when the rays are short; long scattered rays get slower.
+	bool sortBatches;
+
+	BspCollide();
+
+	void Build(const BspTree& tree);
+
+	int PointContents(const float* p) const;
+	int PointContents(const BspVec& p) const;
+
+	// Both return true on a hit, with the first point of contact in hit
+	bool Trace(const float* start, const float* end, float radius, BspHit& hit) const;
+	bool Trace(const BspVec& start, const BspVec& end, fix16 radius, BspHitFixed& hit) const;
+
+	// Traces four rays together with SSE, one per lane, filling four hits and returning a bit
+	// per lane that hit. Rays that start close together and head the same way share node
+	// fetches and plane tests; lanes that disagree about a plane split off and are walked
+	// separately under a mask, so scattered rays are better off going one at a time.
+	int TracePacket(const BspRay* rays, float radius, BspHit* hits) const;
+
+	// Same as Trace for each ray, split into tiles across threadCount threads. Runs of four rays
+	// heading into the same octant go through TracePacket.
+	void TraceBatch(const BspRay* rays, int count, float radius, BspHit* hits) const;
+
+	// Casts random rays through the tree's bounds and times each flavour of query, then does
+	// the same with bundles of similar rays for the packet traces
+	void Benchmark(int rayCount, BspRayBench& out) const;
+
+private:
+	struct Node
+	{
+		float nx, ny, nz, d;
+		int children[2];
+	};
+
+	const BspTree* tree;
+	std::vector<Node> nodes;
+	std::vector<unsigned char> solid;
+	int maxDepth;
+	float boundsMin[3], boundsMax[3];
+
+	void FillHit(bool any, float fraction, int plane, BspHit& hit) const;
+	void SortRays(const BspRay* rays, int count, std::vector<uint32_t>& order) const;
+};
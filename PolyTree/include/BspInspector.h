@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "BspTree.h"
+
+// Browses the node, plane and triangle arrays of a compiled tree. Rows are clipped to the
+// scrolled region before anything gets formatted, so the cost per frame is the handful of rows
+// on screen however big the tree is.
+class BspInspector
+{
+public:
+	bool open;
+
+	BspInspector();
+
+	void Draw(const BspTree& tree);
+
+private:
+	enum Table
+	{
+		TABLE_NODES,
+		TABLE_PLANES,
+		TABLE_TRIS,
+		TABLE_COUNT
+	};
+
+	int selectedNode;
+	int gotoRow[TABLE_COUNT];
+	int scrollTo[TABLE_COUNT];		// row to bring into view next time the table is drawn, -1 for none
+
+	// Node each triangle lies on, rebuilt when the tree changes
+	std::vector<int> triNodes;
+	const BspTree* triNodesTree;
+	size_t triNodesCount;
+
+	void DrawNodes(const BspTree& tree);
+	void DrawPlanes(const BspTree& tree);
+	void DrawTris(const BspTree& tree);
+
+	bool BeginTable(Table table, int rowCount, int columnCount, const char* const* headers);
+	void EndTable();
+	void SelectNode(const BspTree& tree, int node);
+	void UpdateTriNodes(const BspTree& tree);
+};
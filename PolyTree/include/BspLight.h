@@ -0,0 +1,43 @@
+#pragma once
+
+#include "BspTree.h"
+#include "BspCollide.h"
+#include "BuildProgress.h"
+
+// Bakes direct light from a single sun plus ambient occlusion into the tree's vertLight, tracing
+// shadow and occlusion rays against the compiled tree
+class BspLight
+{
+public:
+	float sunDir[3];		// towards the sun
+	float sunIntensity;
+	float ambientIntensity;
+	int aoSamples;
+	float aoDistance;		// as a fraction of the model's size
+	int threadCount;
+
+	double bakeSeconds;
+	long long raysCast;
+
+	// Reported to while baking if set. Cancelling stops at the next tile, leaving the rest dark.
+	BuildProgress* progress;
+
+	BspLight();
+
+	// Fills out with one intensity per vert rather than the tree's own vertLight, so the tree can
+	// go on being drawn while a bake runs on another thread
+	void Bake(const BspTree& tree, const BspCollide& collide, std::vector<unsigned char>& out);
+
+private:
+	struct Vert
+	{
+		float pos[3];
+		float normal[3];
+	};
+
+	std::vector<Vert> bakeVerts;
+	std::vector<float> hemisphere;
+
+	void MakeHemisphere();
+	unsigned char LightVert(int v, const BspCollide& collide, float size) const;
+};
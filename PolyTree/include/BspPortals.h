@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include "BspTree.h"
+#include "BuildProgress.h"
+#include "Winding.h"
+
+struct BspPortal
+{
+	VisWinding winding;
+	VisPlane plane;		// the node plane, facing into leaves[0]
+	int leaves[2];		// front and back leaf
+};
+
+// The convex region a leaf covers, as the polygons bounding it
+struct BspCell
+{
+	int firstFace;
+	int faceCount;
+	bool outside;		// reaches the box around everything
+};
+
+// One side of a convex region on the way down the tree, the region lying in front of its plane
+struct BspCellFace
+{
+	VisPlane plane;
+	VisWinding winding;		// facing outwards
+	bool world;				// part of the box around everything
+};
+
+class BspPortals
+{
+public:
+	std::vector<BspPortal> portals;
+	std::vector<BspCell> cells;
+	std::vector<VisWinding> cellFaces;
+
+	int emptyLeaves, solidLeaves;
+	double portalSeconds, cellSeconds;
+
+	BuildProgress* progress;
+
+	BspPortals();
+
+	// Finds the portals between neighbouring empty leaves by cutting each node plane down to
+	// the node's cell and pushing it through both subtrees, then extracts every leaf's cell
+	void Build(const BspTree& tree);
+
+private:
+	// Each node's region is cut from its parent's rather than from every plane on the way down
+	void BoxCell(const VisPlane* box, std::vector<BspCellFace>& cell) const;
+	void SplitCell(const std::vector<BspCellFace>& cell, const VisPlane& p, VisWinding& cut,
+		std::vector<BspCellFace>& front, std::vector<BspCellFace>& back) const;
+
+	void MakeNodePortals(const BspTree& tree, const std::vector<BspCellFace>& world);
+	void PushWinding(const BspTree& tree, const VisWinding& w, int child, std::vector<VisWinding>& windings, std::vector<int>& leaves) const;
+	void MakeCells(const BspTree& tree, const std::vector<BspCellFace>& world);
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BspTree.h"
+
+// Rough working memory per triangle for an in-core build, index lists, verts and split
+// fragments included, used to decide how much of a bucket fits in the budget
+#define BSP_STREAM_TRI_BYTES 320
+
+// Triangles kept from each bucket to choose its splitter from
+#define BSP_STREAM_SAMPLE 4096
+
+struct BspTri
+{
+	BspVec v[3];
+};
+
+// Somewhere to pull triangles from a batch at a time
+class BspTriSource
+{
+public:
+	virtual ~BspTriSource() {}
+
+	// Fills up to max triangles, returns how many, 0 at the end or -1 on error
+	virtual int Read(BspTri* out, int max) = 0;
+};
+
+// Triangles from an already loaded mesh. Given ownership, the loader's arrays are freed once
+// the last triangle has been read, so they're gone before the tree starts to grow.
+class BspObjSource : public BspTriSource
+{
+public:
+	BspObjSource(Obj& o, bool freeWhenDone);
+	~BspObjSource();
+
+	int Read(BspTri* out, int max);
+
+private:
+	Obj& o;
+	bool freeWhenDone;
+	int next;
+
+	void Free();
+};
+
+// Triangles straight from an .obj file, parsed on a thread of its own a batch at a time so the
+// builder can be partitioning one batch while the next is read and parsed. Only the verts are
+// kept, as faces can refer back to any of them; faces are fanned into triangles as they come.
+class BspObjStream : public BspTriSource
+{
+public:
+	// Filled in as the file is read
+	std::atomic<long long> bytesRead;
+	std::atomic<long long> vertCount;
+	std::atomic<long long> triCount;
+
+	// Time Read spent waiting on the parser, which is all the reading that didn't overlap
+	double waitSeconds;
+
+	BspObjStream();
+	~BspObjStream();
+
+	bool Open(const char* path);
+	int Read(BspTri* out, int max);
+
+	// Stops the reader and drops whatever it had parsed, there's nothing more to Read after it
+	void Close();
+
+private:
+	FILE* f;
+	std::thread reader;
+	std::mutex mutex;
+	std::condition_variable ready, space;
+	std::deque<std::vector<BspTri> > full;
+	std::vector<std::vector<BspTri> > spare;
+	std::vector<BspTri> current;
+	size_t currentNext;
+	bool done, failed, stopping;
+
+	std::vector<BspVec> verts;
+
+	void Run();
+	bool ParseLine(char* line, std::vector<BspTri>& batch);
+	bool Push(std::vector<BspTri>& batch);
+};
+
+// Builds a tree that needn't fit in memory while it's built. Triangles are kept in memory as
+// they're read until there are more than fit, then a plane chosen from those splits them and
+// everything still to come into front and back bucket files as it arrives. Each bucket too big
+// for the budget is split again the same way, by a plane chosen from a sample of it. Buckets that
+// fit are built in memory straight into the tree, which ends up laid out just as BspTree::Build
+// would.
+//
+// Only the working set is capped: the finished tree is still kept in memory.
+class BspStreamBuilder
+{
+public:
+	long long memoryBudget;		// bytes
+	std::string tmpDir;			// where the buckets go
+	BuildProgress* progress;
+
+	// Filled in by Build
+	int buckets;
+	int inCoreBuckets;
+	int forcedBuckets;			// still too big, but the split hardly made them any smaller
+	int maxDepth;				// levels of streamed splits
+	long long bytesSpilled;
+	long long trisRead;
+	double readSeconds;			// until the source ran dry, the root split having gone along with it
+	double seconds;
+
+	BspStreamBuilder();
+
+	// Returns false if the source or a bucket file fails, leaving the tree empty
+	bool Build(BspTree& tree, BspTriSource& source);
+
+private:
+	struct Bucket
+	{
+		std::string path;
+		long long count;
+		std::vector<BspTri> sample;
+	};
+
+	// A node being split by streaming triangles through it
+	struct Split
+	{
+		BspPlane p;
+		BspTri splitter;
+		bool axis;					// cut through the middle rather than on the splitter's plane
+		Bucket front, back;
+		FILE* frontFile;
+		FILE* backFile;
+		std::vector<BspTri> onFront, onBack;
+		std::vector<unsigned int> fragFront, fragBack;
+	};
+
+	BspTree* tree;
+	BspTree scratch;			// classification and clipping away from the tree's own verts
+	long long inCoreTris;
+	std::string prefix;
+	int nextFile;
+	uint64_t rng;
+	bool failed;
+
+	bool ReadSource(BspTriSource& source, std::vector<BspTri>& tris, Split& root, long long& count);
+	int BuildBucket(Bucket& bucket, int leafContents, long long work, int depth, long long parentCount);
+	int BuildSplit(Split& s, long long work, int depth, long long count);
+	int BuildInCore(std::vector<BspTri>& tris, int leafContents, long long work);
+	bool ReadBucket(const Bucket& bucket, std::vector<BspTri>& tris);
+
+	bool MakePlane(const BspTri& t, BspPlane& p);
+	FILE* OpenBucket(Bucket& bucket);
+	void Emit(FILE* f, Bucket& bucket, const BspTri& t);
+
+	bool Balanced(const std::vector<unsigned int>& sampleTris, const BspPlane& p) const;
+	bool BeginSplit(Split& s, const std::vector<BspTri>& sample);
+	void Partition(Split& s, const BspTri& t);
+	bool EndSplit(Split& s, bool ok);
+};
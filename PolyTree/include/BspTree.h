@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "BuildProgress.h"
+
+extern "C"
+{
+	#include "Obj.h"
+}
+
+// Everything in the tree is kept in 16.16 fixed point, same as the Atari side
+typedef int32_t fix16;
+
+#define FIX_ONE 65536
+#define BSP_EPSILON (FIX_ONE / 1024)
+
+// Child values below zero are leaves rather than node indices, BSP_LEAF converts either way
+#define BSP_LEAF(child) (-(child) - 1)
+
+#define BSP_EMPTY 0
+#define BSP_SOLID 1
+
+#define BSP_OUTSIDE 0
+#define BSP_INSIDE 1
+#define BSP_INTERSECT 2
+
+// Progress units for a whole build, shared out down the tree by triangle count
+#define BSP_BUILD_WORK (1LL << 30)
+
+struct BspVec
+{
+	fix16 x, y, z;
+};
+
+struct BspPlane
+{
+	fix16 nx, ny, nz;	// unit normal
+	fix16 d;			// points on the plane satisfy n.p == d
+};
+
+struct BspBounds
+{
+	BspVec min, max;
+};
+
+struct BspNode
+{
+	int plane;
+	int front, back;
+
+	// Triangles lying on the node plane, the ones facing along the normal first
+	int firstTri;
+	int frontTriCount;
+	int backTriCount;
+
+	// Nodes and triangles are stored in pre-order, so a subtree is the range [this, nodeEnd)
+	// and its triangles are [firstTri, triEnd)
+	int nodeEnd;
+	int triEnd;
+
+	BspBounds bounds;
+};
+
+struct BspLeaf
+{
+	int contents;
+	int visOffset;		// into the compressed PVS, -1 if the leaf has none
+};
+
+struct BspFrustum
+{
+	float planes[6][4];
+
+	// Column-major model-view-projection matrix, as glm stores it
+	BspFrustum(const float* mvp);
+
+	int Test(const BspBounds& b) const;
+};
+
+struct BspRange
+{
+	int firstTri;
+	int triCount;
+};
+
+struct BspCullStats
+{
+	int nodesVisited;
+	int nodesCulled;
+	int nodesPvsCulled;
+	int trisFrustumCulled;
+	int trisBackfaceCulled;
+	int trisPvsCulled;
+	int trisDrawn;
+};
+
+// A subtree waiting to be built, or with node set, a node waiting on its children
+struct BspBuildTask
+{
+	std::vector<unsigned int> tris;
+	int leafContents;
+	long long work;
+	int parent;			// -1 at the root
+	bool front;			// which of the parent's children it is
+	int node;
+};
+
+class BspTree
+{
+public:
+	std::vector<BspVec> verts;
+	std::vector<unsigned int> indices;
+	std::vector<BspPlane> planes;
+	std::vector<BspNode> nodes;
+	std::vector<BspLeaf> leaves;
+
+	// Run-length compressed leaf-to-leaf visibility, one bit per leaf with runs of zero bytes
+	// stored as a zero followed by the run length
+	std::vector<unsigned char> visData;
+
+	// Baked lighting, one intensity per vert, empty until BspLight has been run
+	std::vector<unsigned char> vertLight;
+
+	int splitCount;
+	double buildSeconds;
+
+	// Splitter choice: how many candidate planes to try per node, how many triangles to test each
+	// against, and how many unbalanced triangles a split is worth
+	int splitterCandidates;
+	int splitterSamples;
+	int splitPenalty;
+
+	// Reported to while building if set. Cancelling turns whatever is left into leaves.
+	BuildProgress* progress;
+
+	BspTree();
+
+	void Build(const Obj& o);
+
+	int TriCount() const { return (int)indices.size() / 3; }
+
+	// 16.16 verts to floats, as they go to GL
+	static void ToFloat(const BspVec* in, size_t count, float* out);
+
+	// Signed distance from a plane, 16.16
+	fix16 Distance(const BspPlane& p, const BspVec& v) const;
+
+	int FindLeaf(const BspVec& v) const;
+	bool PointInSolid(const BspVec& v) const { return leaves[FindLeaf(v)].contents == BSP_SOLID; }
+
+	// Expands a leaf's PVS into one bit per leaf, returns false if there's no PVS for it
+	bool DecompressVis(int leaf, std::vector<unsigned char>& out) const;
+
+	// Flags every node with a potentially visible leaf somewhere underneath it
+	void MarkVisibleNodes(int leaf, std::vector<unsigned char>& nodeVis) const;
+
+	// Fills out with the triangle ranges that survive frustum and/or backface culling,
+	// eye being the camera position in object space. nodeVis comes from MarkVisibleNodes,
+	// or NULL to skip PVS culling.
+	void CollectVisible(const BspFrustum& frustum, const BspVec& eye, bool frustumCull, bool backfaceCull,
+		const unsigned char* nodeVis, std::vector<BspRange>& out, BspCullStats& stats) const;
+
+	// Writes the compiled tree out big-endian for the Falcon side to load directly
+	bool Export(const char* filename) const;
+
+private:
+	// Builds subtrees straight into the tree, a bucket at a time
+	friend class BspStreamBuilder;
+
+	void Clear();
+	int BuildNode(std::vector<unsigned int>& tris, int leafContents, long long work);
+	int AddLeaf(int contents, long long work);
+
+	// Pushes a node with its on-plane triangles, EndNode fills in the rest once the children are built
+	int BeginNode(const BspPlane& p, const std::vector<unsigned int>& onFront, const std::vector<unsigned int>& onBack);
+	void EndNode(int nodeIndex, int frontChild, int backChild);
+	void ShareWork(long long work, size_t on, size_t front, size_t back, long long& frontWork, long long& backWork);
+
+	int ChooseSplitter(const std::vector<unsigned int>& tris);
+	bool AxisPlane(const std::vector<unsigned int>& tris, BspPlane& p) const;
+
+	// Sorts triangles by the plane, splitting those across it. Unpartition throws the result away,
+	// verts added and all.
+	void Partition(const std::vector<unsigned int>& tris, const BspPlane& p, int splitter, std::vector<unsigned int>& front,
+		std::vector<unsigned int>& back, std::vector<unsigned int>& onFront, std::vector<unsigned int>& onBack);
+	void Unpartition(size_t vertCount, int splits, std::vector<unsigned int>& front, std::vector<unsigned int>& back,
+		std::vector<unsigned int>& onFront, std::vector<unsigned int>& onBack);
+	bool MakePlane(const unsigned int* tri, BspPlane& p) const;
+	void SplitTri(const unsigned int* tri, const BspPlane& p, std::vector<unsigned int>& front, std::vector<unsigned int>& back);
+	unsigned int AddVert(const BspVec& v);
+	void GrowBounds(BspBounds& b, const BspVec& v) const;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#include "BspTree.h"
+#include "BspPortals.h"
+#include "BuildProgress.h"
+
+class BspVis
+{
+public:
+	int threadCount;
+	double visSeconds;
+	double averageVisible;
+	int outsideLeaves;		// empty leaves that can be reached from outside the model, which get no PVS
+
+	// Cancelling leaves the leaves that hadn't been flowed yet without a PVS
+	BuildProgress* progress;
+
+	BspVis();
+
+	// Flows visibility through the portals and stores the compressed result in the tree's
+	// leaves and visData
+	void Build(BspTree& tree, const BspPortals& portals);
+
+private:
+	struct FlowPortal
+	{
+		const VisWinding* winding;
+		VisPlane plane;		// facing into leaf
+		int leaf;
+		int owner;
+		std::vector<unsigned char> mightSee;
+	};
+
+	struct FlowStack
+	{
+		VisWinding source;
+		VisWinding pass;
+		VisPlane plane;
+		std::vector<unsigned char> mightSee;
+	};
+
+	std::vector<FlowPortal> flowPortals;
+	std::vector<std::vector<int> > leafPortals;
+	int rowBytes;
+
+	// Finished portals give a much tighter bound than mightSee, so other threads pick them up as they land
+	std::vector<std::vector<unsigned char> > portalVis;
+	std::atomic<int>* portalDone;
+
+	void FillOutside(const BspTree& tree, const BspPortals& portals, std::vector<unsigned char>& outside);
+	void BasePortalVis(int p);
+	void PortalFlow(int base, std::vector<unsigned char>& vis) const;
+	void RecursiveLeafFlow(int base, int leaf, const FlowStack& prev, std::vector<unsigned char>& vis) const;
+	void LeafVis(int leaf, std::vector<unsigned char>& vis);
+};
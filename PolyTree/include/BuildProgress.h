@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+
+// Shared between a build running on a worker thread and the UI watching it. The builder names
+// each stage and ticks work off as it goes, checking Cancelled() at points where it can bail out
+// and leave a valid but partial result.
+class BuildProgress
+{
+public:
+	BuildProgress() : stage("Waiting"), done(0), total(0), cancelled(false) {}
+
+	void Reset()
+	{
+		Begin("Waiting", 0);
+		cancelled = false;
+	}
+
+	// total is in whatever units the stage likes, 0 if it has no way of telling
+	void Begin(const char* name, long long count)
+	{
+		done = 0;
+		total = count;
+		stage = name;
+	}
+
+	void Advance(long long count = 1) { done += count; }
+
+	void Cancel() { cancelled = true; }
+	bool Cancelled() const { return cancelled; }
+
+	const char* Stage() const { return stage; }
+
+	float Fraction() const
+	{
+		long long t = total, d = done;
+		return t <= 0 ? 0.0f : d >= t ? 1.0f : (float)d / t;
+	}
+
+private:
+	std::atomic<const char*> stage;
+	std::atomic<long long> done, total;
+	std::atomic<bool> cancelled;
+};
@@ -2,6 +2,12 @@
 #define IMGUIFILEBROWSER_H
 
 #include <imgui.h>
+#include <atomic>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -33,6 +39,9 @@ namespace imgui_addons
             std::string selected_path;
             std::string ext;    // Store the saved file extension
 
+            /* Called with the full path of whichever file is under the mouse, to fill in a tooltip. */
+            std::function<void(const std::string&)> file_tooltip;
+
 
         private:
             struct Info
@@ -44,6 +53,35 @@ namespace imgui_addons
                 bool is_hidden;
             };
 
+            struct DirListing
+            {
+                std::vector<Info> dirs;
+                std::vector<Info> files;
+            };
+
+            /* Shared between the UI and the thread reading a directory. Entries are handed over in batches as they're read
+             * so big directories fill in progressively, then the whole listing, sorted, once the scan is done.
+             */
+            struct DirScan
+            {
+                std::string path;
+                time_t mtime;
+                std::mutex mutex;
+                DirListing batch;
+                DirListing result;
+                int count = 0;
+                bool done = false;
+                std::atomic<bool> cancelled{false};
+            };
+
+            // Listings of recently visited directories, reused as long as the directory's modification time hasn't changed
+            struct DirCacheEntry
+            {
+                time_t mtime;
+                unsigned int last_used;
+                DirListing listing;
+            };
+
             //Enum used as bit flags.
             enum FilterMode
             {
@@ -82,6 +120,11 @@ namespace imgui_addons
              * reading directories/files
              */
             bool readDIR(std::string path);
+            void startScan(const std::string& path);
+            void cancelScan();
+            void pollScan();
+            void applyListing(const DirListing& listing);
+            static void scanDIR(std::shared_ptr<DirScan> scan);
             bool onNavigationButtonClick(int idx);
             bool onDirClick(int idx);
 
@@ -115,6 +158,10 @@ namespace imgui_addons
             std::vector<const Info*> filtered_dirs; // Note: We don't need to call delete. It's just for storing filtered items from subdirs and subfiles so we don't use PassFilter every frame.
             std::vector<const Info*> filtered_files;
             std::vector< std::reference_wrapper<std::string> > inputcb_filter_files;
+
+            std::shared_ptr<DirScan> dir_scan;
+            std::map<std::string, DirCacheEntry> dir_cache;
+            unsigned int dir_cache_clock;
     };
 }
 
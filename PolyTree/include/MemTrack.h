@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdio.h>
+
+extern "C"
+{
+	#include "Obj.h"
+}
+
+enum MemTag
+{
+	MEM_OTHER,
+	MEM_LOADER,		// OBJ parsing and the loaded or generated mesh
+	MEM_BSP,		// the tree and everything built along the way
+	MEM_VIS,		// portals, cells and the PVS
+	MEM_COLLIDE,	// collision tree and light baking
+	MEM_EXPORT,
+	MEM_GL,			// the scene's GL buffers by size, which drivers often shadow in system memory
+	MEM_TAG_COUNT
+};
+
+struct MemStats
+{
+	long long current;
+	long long peak;
+	long long markPeak;	// since the last Mark
+	long long allocs;
+};
+
+// Bytes in use per pipeline stage. The global operator new and delete are replaced with ones
+// that put the size and the allocating thread's current tag in a small header, so everything a
+// stage allocates, including inside the standard containers, counts against it until it's freed,
+// whichever stage frees it. Memory that doesn't come through new, like the C loader's malloc'd
+// arrays, is added and taken off by hand.
+//
+// Building with POLYTREE_NO_MEMTRACK leaves operator new alone, only the manual counts remain.
+class MemTrack
+{
+public:
+	static MemTag Current();
+
+	static void Add(MemTag tag, long long bytes);
+	static void Sub(MemTag tag, long long bytes);
+
+	static MemStats Stats(MemTag tag);
+	static long long TotalCurrent();
+	static long long TotalPeak();
+
+	// Starts the mark peaks again from what's in use now, to measure one step at a time
+	static void Mark();
+
+	static const char* TagName(MemTag tag);
+
+	// One line per stage, without allocating so it's safe to call when we've run out
+	static void Report(FILE* f);
+
+private:
+	friend class MemScope;
+	static void SetCurrent(MemTag tag);
+};
+
+// Tags everything the calling thread allocates until it goes out of scope. ParallelFor hands
+// the tag on to its workers.
+class MemScope
+{
+public:
+	explicit MemScope(MemTag tag) : previous(MemTrack::Current()) { MemTrack::SetCurrent(tag); }
+	~MemScope() { MemTrack::SetCurrent(previous); }
+
+private:
+	MemTag previous;
+
+	MemScope(const MemScope&);
+	MemScope& operator=(const MemScope&);
+};
+
+// loadObj mallocs both arrays, so an Obj's size is counted by hand
+inline long long ObjBytes(const Obj& o)
+{
+	return (long long)o.vertCount * sizeof(*o.verts) + (long long)o.indexCount * sizeof(*o.indices);
+}
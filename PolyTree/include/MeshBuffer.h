@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "BspTree.h"
+
+// First fit allocator over a range of elements, neighbouring free blocks merging back together
+// as they're returned
+class OffsetAllocator
+{
+public:
+	size_t capacity;
+	size_t used;
+
+	OffsetAllocator();
+
+	void Reset(size_t capacity);
+	void Grow(size_t newCapacity);
+
+	// Start of count free elements, or -1 if there's no gap big enough
+	long long Alloc(size_t count);
+	void Free(size_t offset, size_t count);
+
+private:
+	std::map<size_t, size_t> freeBlocks;	// offset to size
+};
+
+struct MeshSlot
+{
+	int baseVertex;
+	int vertCount;
+	int firstIndex;
+	int indexCount;
+
+	// How many of the indices have reached the GPU so far, the verts always go up first
+	int indicesReady;
+};
+
+// Every mesh in the scene lives in one VAO with shared vertex, light and index buffers, so a
+// frame binds it once and draws each mesh with its base vertex and index offset.
+//
+// Adding a mesh only reserves its slot. The data goes up in chunks through a staging buffer, at
+// most uploadBudget bytes a frame, so a huge mesh fills in over a few frames instead of
+// stalling one.
+class MeshBuffer
+{
+public:
+	unsigned int VAO;
+
+	size_t uploadBudget;
+
+	// Bytes sent and the time spent sending them, on the CPU side, since the start
+	long long uploadedBytes;
+	double uploadSeconds;
+	size_t frameBytes;
+
+	MeshBuffer();
+	~MeshBuffer();
+
+	void Add(const BspTree& bsp, MeshSlot& slot);
+	void Remove(const MeshSlot& slot);
+	void SetLight(const MeshSlot& slot, const std::vector<unsigned char>& light);
+
+	// Sends the next uploadBudget bytes of queued mesh data, once a frame before drawing
+	void Upload();
+	size_t PendingBytes() const;
+
+	size_t VertsUsed() const { return verts.used; }
+	size_t IndicesUsed() const { return indices.used; }
+	size_t Bytes() const { return verts.capacity * (sizeof(float) * 3 + 1) + indices.capacity * sizeof(unsigned int); }
+
+private:
+	struct UploadJob
+	{
+		MeshSlot* slot;
+		const BspTree* bsp;
+		bool indices;		// otherwise the verts, converted to float on the way
+		size_t done, count;	// in elements
+	};
+
+	unsigned int VBO, lightVBO, EBO;
+	unsigned int stagingBuffer;
+	OffsetAllocator verts, indices;
+	std::deque<UploadJob> uploads;
+
+	void Reserve(size_t vertCount, size_t indexCount);
+	void GrowBuffer(unsigned int& buffer, size_t oldBytes, size_t newBytes);
+	void SetupAttributes();
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+extern "C"
+{
+	#include "Obj.h"
+}
+
+enum MeshGenKind
+{
+	MESHGEN_SOUP,		// small triangles scattered through a box
+	MESHGEN_GRID,		// one bumpy heightfield
+	MESHGEN_INTERIOR,	// a room cluttered with boxes, some of them turned
+	MESHGEN_COPLANAR,	// quads scattered over a handful of shared planes
+	MESHGEN_SLIVERS,	// long thin triangles crossing each other
+	MESHGEN_KIND_COUNT
+};
+
+typedef std::remove_pointer<decltype(Obj::verts)>::type ObjVertex;
+typedef std::remove_pointer<decltype(Obj::indices)>::type ObjIndex;
+
+// Parametric test meshes for benchmarking and fuzzing the BSP, from best cases to worst. The same
+// kind, count and seed always give the same mesh. Work is split into fixed size chunks that each
+// seed their own random numbers, so chunks can be generated on as many threads as there are and
+// written out in order without holding the whole mesh, which is what makes 100M triangle files
+// practical.
+class MeshGen
+{
+public:
+	MeshGenKind kind;
+	long long triCount;		// a target, grids round down to whole rows and rooms to whole boxes
+	uint32_t seed;
+	float size;				// half the width of the space used, 0 to scale it with the count
+	int threadCount;
+
+	// From the last Generate or Write
+	long long vertsMade, trisMade;
+	long long bytesWritten;
+	double seconds;
+
+	MeshGen();
+
+	// Fills out as loadObj would, the arrays belonging to this generator until the next call
+	void Generate(Obj& out);
+	void Clear();
+
+	// Streams straight to an .obj file, returning false if it couldn't be written
+	bool Write(const char* filename);
+
+	static const char* KindName(MeshGenKind kind);
+	static bool FindKind(const char* name, MeshGenKind& kind);
+
+private:
+	struct Chunk
+	{
+		std::vector<float> verts;
+		std::vector<long long> tris;	// relative to the chunk's first vert, negative reaching back into earlier chunks
+		long long base;
+		std::string text;
+	};
+
+	std::vector<ObjVertex> verts;
+	std::vector<ObjIndex> indices;
+
+	float Extent() const;
+	long long ChunkCount() const;
+	int GridSide() const;
+	void GenerateChunk(long long chunk, Chunk& out) const;
+	void FormatChunk(Chunk& chunk) const;
+
+	void Soup(long long count, uint32_t& rng, Chunk& out) const;
+	void Grid(long long chunk, Chunk& out) const;
+	void Interior(long long first, long long count, uint32_t& rng, Chunk& out) const;
+	void Coplanar(long long first, long long count, uint32_t& rng, Chunk& out) const;
+	void Slivers(long long count, uint32_t& rng, Chunk& out) const;
+};
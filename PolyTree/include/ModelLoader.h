@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "AtariObj.h"
+#include "BuildProgress.h"
+
+// Loads and compiles a model on a worker thread so the UI keeps running, handing the finished
+// mesh back to the render thread for the GL side. Lighting bakes go the same way. One job at a time.
+class ModelLoader
+{
+public:
+	ModelLoader();
+	~ModelLoader();
+
+	bool Busy() const { return running; }
+	const BuildProgress& Progress() const { return progress; }
+	const std::string& Name() const { return name; }
+
+	void Start(const char* path, const char* displayName, bool buildVis);
+	void Cancel() { progress.Cancel(); }
+
+	// Cancels whatever is running and waits for the worker to give up on it
+	void Stop();
+
+	// Bakes lighting for a mesh already in the scene, which has to stay there until Poll has
+	// handed the result over to it
+	void Bake(AtariObj* obj, const char* displayName);
+
+	// Call once a frame. Hands over the mesh once the worker is finished with it, otherwise
+	// returns NULL, including when the load was cancelled. A finished bake is applied here.
+	AtariObj* Poll();
+
+private:
+	std::thread worker;
+	std::atomic<bool> finished;
+	bool running;
+	bool succeeded;
+	bool buildVis;
+	AtariObj* obj;
+	AtariObj* baking;
+	BuildProgress progress;
+	std::string path, name;
+
+	void Join();
+};
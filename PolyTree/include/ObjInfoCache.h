@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define OBJ_THUMB_SIZE 64
+
+struct ObjInfo
+{
+	int vertCount;
+	int faceCount;
+	int triCount;		// faces fanned into triangles
+	float boundsMin[3], boundsMax[3];
+
+	// One bit a pixel wireframe, rows top to bottom, only there for files small enough to keep
+	// every vert of in memory while scanning
+	bool hasThumb;
+	unsigned char thumb[OBJ_THUMB_SIZE * OBJ_THUMB_SIZE / 8];
+};
+
+// Counts, bounds and a wireframe thumbnail for OBJ files, worked out by a pool of threads with a
+// quick pass over the text rather than a full load, so big models can be sized up before opening
+// them. Results are kept on disk by path, size and modification time.
+class ObjInfoCache
+{
+public:
+	ObjInfoCache(const char* cachePath);
+	~ObjInfoCache();
+
+	// The info for path if it's been scanned, NULL while it's waiting or if the file can't be read.
+	// The first call for a path queues the scan, and it's queued again if the file has changed since.
+	const ObjInfo* Get(const std::string& path);
+
+	// Texture for the thumbnail, made on first use so it has to be called on the GL thread, 0 if
+	// there isn't one yet
+	unsigned int Thumbnail(const std::string& path);
+
+	int Pending();
+	bool Save();
+
+	// Scans a file on the calling thread
+	static bool Scan(const char* path, ObjInfo& info);
+
+private:
+	enum State
+	{
+		STATE_QUEUED,
+		STATE_READY,
+		STATE_FAILED
+	};
+
+	struct Entry
+	{
+		int64_t mtime, size;
+		State state;
+		std::chrono::steady_clock::time_point checkedAt;	// last compared against the file's mtime and size
+		unsigned int texture;
+		ObjInfo info;
+	};
+
+	std::string cachePath;
+	std::map<std::string, Entry> entries;
+	std::vector<unsigned int> staleTextures;	// thumbnails of files that changed, freed by Thumbnail on the GL thread
+	std::deque<std::string> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<std::thread> workers;
+	bool stopping;
+	bool dirty;
+
+	void Load();
+	void Work();
+};
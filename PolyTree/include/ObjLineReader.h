@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+// Hands out an OBJ's lines from a fixed size buffer. Lines get cut out of the buffer in place,
+// with whatever's left of the last one carried over to the start for the next read.
+class ObjLineReader
+{
+public:
+	ObjLineReader(FILE* file, size_t bufferSize);
+
+	// The next line, NUL terminated without its newline and only good until the next call, or NULL
+	// at the end of the file
+	char* Next();
+
+	// Bytes of the file read so far
+	long long BytesRead() const { return bytesRead; }
+
+	// Next position index on a face line, anything after a slash skipped. Returns false at the end
+	// of the line.
+	static bool FaceIndex(char*& p, long long& index);
+
+private:
+	FILE* f;
+	std::vector<char> buffer;
+	size_t size;
+	size_t end;
+	size_t lineStart;
+	long long bytesRead;
+	bool atEnd;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "MemTrack.h"
+#include "Trace.h"
+
+inline int HardwareThreads()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count ? (int)count : 1;
+}
+
+// Runs job(i) for every i in [0, count) across threadCount threads, each thread pulling the next
+// index off a shared counter so uneven jobs still balance out
+template <typename Job>
+void ParallelFor(int count, int threadCount, Job job)
+{
+	std::atomic<int> next(0);
+	std::vector<std::thread> threads;
+	MemTag tag = MemTrack::Current();
+
+	if (threadCount <= 1 || count <= 1)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			job(i);
+		}
+
+		return;
+	}
+
+	for (int t = 0; t < threadCount; t++)
+	{
+		threads.push_back(std::thread([&]()
+		{
+			if (::Trace::Recording())
+			{
+				::Trace::SetThreadName("Worker");
+			}
+
+			MemScope mem(tag);
+			TRACE_SCOPE("ParallelFor");
+
+			for (int i = next++; i < count; i = next++)
+			{
+				job(i);
+			}
+		}));
+	}
+
+	for (size_t t = 0; t < threads.size(); t++)
+	{
+		threads[t].join();
+	}
+}
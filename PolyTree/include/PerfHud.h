@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#define PERF_HISTORY 240
+#define PERF_QUERY_FRAMES 4		// GPU timers in flight, so reading one back never waits on the GPU
+
+enum PerfGpuTimer
+{
+	PERF_GPU_SCENE,
+	PERF_GPU_IMGUI,
+	PERF_GPU_TIMER_COUNT
+};
+
+// The last PERF_HISTORY samples of something, in milliseconds
+class PerfSeries
+{
+public:
+	PerfSeries();
+
+	void Add(float ms);
+
+	int Count() const { return count; }
+	float Last() const { return count ? values[(next + PERF_HISTORY - 1) % PERF_HISTORY] : 0.0f; }
+	float Percentile(float p) const;
+
+	// Oldest first, for plotting
+	void Ordered(std::vector<float>& out) const;
+
+private:
+	float values[PERF_HISTORY];
+	int count, next;
+};
+
+// Frame timing overlay: CPU frame and work time, GPU time from GL_TIME_ELAPSED queries around
+// the scene and ImGui, draw and triangle counts, a rolling graph plus a histogram of recent
+// frame times with p50/p99, and memory in use by each stage.
+//
+// Each timer cycles through PERF_QUERY_FRAMES queries, so results are picked up a few frames
+// late rather than stalling the pipeline to get them straight away.
+class PerfHud
+{
+public:
+	bool open;
+
+	PerfHud();
+	~PerfHud();
+
+	// Call at the top of the main loop, and EndFrame just before the swap
+	void BeginFrame();
+	void EndFrame();
+
+	// Timers can't nest or overlap, GL only runs one GL_TIME_ELAPSED query at a time
+	void BeginGpu(PerfGpuTimer timer);
+	void EndGpu(PerfGpuTimer timer);
+
+	// What went to the GPU this frame, shown from the next
+	void SetCounts(int sceneDraws, long long sceneTris, int imguiDraws, long long imguiTris);
+
+	void Draw();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point frameStart;
+	bool started;
+	PerfSeries frameTime, cpuTime;
+	PerfSeries gpuTime[PERF_GPU_TIMER_COUNT];
+
+	unsigned int queries[PERF_QUERY_FRAMES][PERF_GPU_TIMER_COUNT];
+	bool pending[PERF_QUERY_FRAMES][PERF_GPU_TIMER_COUNT];
+	int frame;
+	bool gpuSupported;
+
+	int sceneDraws, imguiDraws;
+	long long sceneTris, imguiTris;
+
+	std::vector<float> plot;
+
+	void Collect(int slot, PerfGpuTimer timer, bool wait);
+	void SeriesText(const char* label, const PerfSeries& series);
+};
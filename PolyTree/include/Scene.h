@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AtariObj.h"
+#include "MeshBuffer.h"
+#include "Shader.h"
+
+struct SceneMesh
+{
+	AtariObj* obj;
+	std::string name;
+	std::vector<glm::mat4> instances;
+};
+
+// Everything loaded into the viewer, all sharing one MeshBuffer. Meshes with a single instance
+// are BSP culled and their ranges batched into multi-draws, one per run of meshes with the same
+// transform; anything more gets frustum tested per instance and drawn instanced.
+class Scene
+{
+public:
+	std::vector<SceneMesh> meshes;
+	MeshBuffer buffer;
+	int selected;
+
+	int instancesDrawn, instancesCulled, drawCalls;
+	long long trisSubmitted;
+
+	Scene();
+	~Scene();
+
+	// Takes ownership of obj, giving it a single instance at the origin
+	int AddMesh(AtariObj* obj, const char* name);
+	void AddInstance(int mesh, const glm::mat4& transform);
+	void Clear();
+
+	AtariObj* Selected() const { return selected >= 0 ? meshes[selected].obj : NULL; }
+	int InstanceCount() const;
+
+	// Replaces a mesh's instances with count copies laid out on a grid, for stress testing
+	void Stress(int mesh, int count);
+
+	void Render(const Shader& shader, int transformLoc, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection);
+
+private:
+	unsigned int instanceVBO;
+	size_t instanceCapacity;
+	std::vector<glm::mat4> visible;
+	std::vector<size_t> visibleStart;
+
+	// Multi-draw command list, built on the CPU and flushed whenever the transform or draw state changes
+	std::vector<int> drawCounts;
+	std::vector<const void*> drawOffsets;
+	std::vector<int> drawBaseVertices;
+	glm::mat4 batchWorld;
+	bool batchLit;
+
+	void Flush(const Shader& shader, int transformLoc);
+	void SetDrawState(bool lit, bool instanced, size_t instanceOffset);
+};
@@ -1,12 +1,86 @@
 #pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+// Uniform block binding points shared by every program
+#define SHADER_CAMERA_BINDING 0
+
+// Matches the std140 Camera block in the shaders
+struct ShaderCamera
+{
+	glm::mat4 camera;
+	glm::mat4 projection;
+};
+
 class Shader
 {
 public:
 	unsigned int programId;
 	char errorLog[1024];
 
+	// Links from a cached program binary when there's one for these sources and this driver,
+	// otherwise compiles and caches the result
 	Shader(const char* vPath, const char* fPath);
+	~Shader();
 
 	void Use();
+
+	// Call on the GL thread. Rebuilds the program if a background thread has seen either source
+	// file change, swapping it in only if it compiles and links; otherwise the old program stays
+	// and errorLog says why. Returns true on a swap, after which uniform locations need fetching again.
+	bool Reload();
+
+	// Location of an active uniform, looked up once at link time. -1 if the program doesn't
+	// use it, which the setters quietly ignore just like GL does.
+	int Uniform(const char* name) const;
+
+	// Setters for the program that's in use
+	void Set(int location, int v) const;
+	void Set(int location, float v) const;
+	void Set(int location, const glm::vec3& v) const;
+	void Set(int location, const glm::vec4& v) const;
+	void Set(int location, const glm::mat4& m) const;
+
+private:
+	std::unordered_map<std::string, int> uniforms;
+	std::string vertexPath, fragmentPath;
+
+	std::thread watcher;
+	std::mutex watchMutex;
+	std::condition_variable watchStop;
+	bool watching;
+	std::atomic<bool> changed;
+	time_t vertexTime, fragmentTime;
+
+	bool Load();
+	void Swap(unsigned int program);
+	void Reflect();
+	void Watch();
+
+	// Cached program binaries, skipping the compile when the sources and driver haven't changed
+	bool LoadBinary(const char* path, uint64_t key, unsigned int& program);
+	void SaveBinary(const char* path, uint64_t key) const;
 };
 
+// A std140 uniform buffer bound to a fixed binding point, so one update reaches every program
+// with the matching block
+class UniformBlock
+{
+public:
+	unsigned int bufferId;
+	int size;
+
+	UniformBlock(int size, unsigned int binding);
+	~UniformBlock();
+
+	void Update(const void* data);
+};
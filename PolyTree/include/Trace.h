@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TRACE_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_RDTSC 1
+#endif
+
+// Most events a single thread keeps per recording, anything past this is counted and dropped
+#define TRACE_MAX_EVENTS (1 << 20)
+
+// Scoped timers for the expensive paths, saved as a Chrome trace for chrome://tracing or
+// ui.perfetto.dev. Each thread records into a buffer of its own using the CPU's timestamp
+// counter, so a scope is two counter reads and an append while recording and one flag test when
+// not. Building with POLYTREE_NO_TRACE takes the scopes out altogether.
+//
+// Names are kept by pointer, so they have to be string literals or something else that outlives
+// the recording.
+class Trace
+{
+public:
+	// Start throws away whatever was recorded before
+	static void Start();
+	static void Stop();
+	static bool Recording() { return recording.load(std::memory_order_relaxed); }
+
+	// Writes everything recorded so far, best called after Stop
+	static bool Save(const char* filename);
+
+	// Labels the calling thread's row in the trace
+	static void SetThreadName(const char* name);
+
+	static long long EventCount();
+	static long long DroppedCount();
+
+	static uint64_t Now()
+	{
+#ifdef TRACE_RDTSC
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	static void Record(const char* name, uint64_t start, uint64_t end);
+
+private:
+	static std::atomic<bool> recording;
+};
+
+class TraceScope
+{
+public:
+	// A NULL name records nothing, for scopes that are only worth having some of the time
+	explicit TraceScope(const char* name) : name(name && Trace::Recording() ? name : NULL), start(this->name ? Trace::Now() : 0) {}
+
+	~TraceScope()
+	{
+		if (name)
+		{
+			Trace::Record(name, start, Trace::Now());
+		}
+	}
+
+private:
+	const char* name;
+	uint64_t start;
+
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+
+#ifdef POLYTREE_NO_TRACE
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_IF(condition, name)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_JOIN(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_IF(condition, name) TraceScope TRACE_JOIN(traceScope, __LINE__)((condition) ? (name) : NULL)
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "BspTree.h"
+
+// Portals, cells and vis work in doubles in object space; none of it ends up in the export
+// apart from the compressed PVS itself
+#define VIS_EPSILON 0.001
+
+struct VisPoint
+{
+	double x, y, z;
+};
+
+struct VisPlane
+{
+	double x, y, z;
+	double d;
+};
+
+typedef std::vector<VisPoint> VisWinding;
+
+double PlaneDist(const VisPlane& p, const VisPoint& v);
+VisPlane FlipPlane(const VisPlane& p);
+VisPlane ToVisPlane(const BspPlane& p);
+
+// A square of the given half size lying on the plane
+VisWinding BaseWinding(const VisPlane& p, double size);
+
+// Splits in two, points on the plane going to both sides. A winding lying on the plane goes to the front.
+void SplitWinding(const VisWinding& in, const VisPlane& p, VisWinding& front, VisWinding& back);
+
+// Keeps whatever is in front of the plane; anything lying on it or behind it is thrown away
+bool ChopWinding(VisWinding& w, const VisPlane& p);
@@ -0,0 +1,358 @@
+#include "AssetIndex.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined (WIN32) || defined (_WIN32) || defined (__WIN32)
+#include "Dirent/dirent.h"
+#else
+#include <dirent.h>
+#endif
+
+static uint32_t Trigram(const char* s)
+{
+	return ((uint32_t)(unsigned char)s[0] << 16) | ((uint32_t)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+}
+
+static std::string ToLower(const std::string& s)
+{
+	std::string out(s);
+
+	for (size_t i = 0; i < out.size(); i++)
+	{
+		out[i] = (char)tolower((unsigned char)out[i]);
+	}
+
+	return out;
+}
+
+// Sorted a slice at a time and merged back up, so a cancel only has to wait out one slice or merge
+static void SortPairs(std::vector<uint64_t>& pairs, const std::atomic<bool>& cancelled)
+{
+	const size_t slice = 1 << 18;
+	size_t count = pairs.size();
+
+	for (size_t s = 0; s < count && !cancelled; s += slice)
+	{
+		std::sort(pairs.begin() + s, pairs.begin() + std::min(s + slice, count));
+	}
+
+	for (size_t width = slice; width < count && !cancelled; width *= 2)
+	{
+		for (size_t s = 0; s + width < count && !cancelled; s += width * 2)
+		{
+			std::inplace_merge(pairs.begin() + s, pairs.begin() + s + width, pairs.begin() + std::min(s + width * 2, count));
+		}
+	}
+}
+
+static bool HasExtension(const std::string& name, const std::string& extension)
+{
+	if (name.size() < extension.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < extension.size(); i++)
+	{
+		if (tolower((unsigned char)name[name.size() - extension.size() + i]) != tolower((unsigned char)extension[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+AssetIndex::AssetIndex() : finished(false), cancelled(false), found(0)
+{
+	buildSeconds = 0.0;
+	querySeconds = 0.0;
+	running = false;
+}
+
+AssetIndex::~AssetIndex()
+{
+	Cancel();
+	Join();
+}
+
+void AssetIndex::Join()
+{
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+
+	running = false;
+}
+
+void AssetIndex::Build(const char* root, const char* extension)
+{
+	Cancel();
+	Join();
+
+	std::string rootPath(root);
+
+	if (!rootPath.empty() && rootPath.back() != '/' && rootPath.back() != '\\')
+	{
+		rootPath += '/';
+	}
+
+	finished = false;
+	cancelled = false;
+	found = 0;
+	running = true;
+	worker = std::thread(&AssetIndex::BuildIndex, this, rootPath, std::string(extension));
+}
+
+bool AssetIndex::Update()
+{
+	if (!running || !finished)
+	{
+		return false;
+	}
+
+	Join();
+
+	if (!built)
+	{
+		return false;
+	}
+
+	index.swap(built);
+	built.reset();
+	return true;
+}
+
+bool AssetIndex::Walk(const std::string& root, const std::string& dir, const std::string& extension, Index& out)
+{
+	DIR* d = opendir((root + dir).c_str());
+	struct dirent* ent;
+
+	if (!d)
+	{
+		return true;
+	}
+
+	while (!cancelled && (ent = readdir(d)) != NULL)
+	{
+		const char* name = ent->d_name;
+
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+		{
+			continue;
+		}
+
+		// Links aren't followed, so a loop in the tree can't trap us
+		if (ent->d_type == DT_DIR)
+		{
+			Walk(root, dir + name + "/", extension, out);
+		}
+		else if (ent->d_type == DT_REG && HasExtension(name, extension))
+		{
+			out.paths.push_back(dir + name);
+			found++;
+		}
+	}
+
+	closedir(d);
+	return !cancelled;
+}
+
+void AssetIndex::BuildIndex(std::string root, std::string extension)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	std::unique_ptr<Index> out(new Index());
+	std::vector<uint64_t> pairs;
+
+	out->root = root;
+
+	if (!Walk(root, "", extension, *out))
+	{
+		finished = true;
+		return;
+	}
+
+	std::sort(out->paths.begin(), out->paths.end());
+	out->lower.resize(out->paths.size());
+
+	// Every (trigram, path) pair, sorted and deduplicated, turns straight into the postings.
+	// Cancelling is checked through each pass as well as the walk, as Build waits on it.
+	for (size_t i = 0; i < out->paths.size() && !cancelled; i++)
+	{
+		const std::string& lower = out->lower[i] = ToLower(out->paths[i]);
+
+		for (size_t c = 0; c + 3 <= lower.size(); c++)
+		{
+			pairs.push_back(((uint64_t)Trigram(&lower[c]) << 32) | i);
+		}
+	}
+
+	SortPairs(pairs, cancelled);
+
+	if (cancelled)
+	{
+		finished = true;
+		return;
+	}
+
+	pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+	out->ids.resize(pairs.size());
+
+	for (size_t i = 0; i < pairs.size() && !cancelled; i++)
+	{
+		uint32_t trigram = (uint32_t)(pairs[i] >> 32);
+
+		if (out->trigrams.empty() || out->trigrams.back() != trigram)
+		{
+			out->trigrams.push_back(trigram);
+			out->offsets.push_back((uint32_t)i);
+		}
+
+		out->ids[i] = (uint32_t)pairs[i];
+	}
+
+	if (cancelled)
+	{
+		finished = true;
+		return;
+	}
+
+	out->offsets.push_back((uint32_t)pairs.size());
+
+	buildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	built.swap(out);
+	finished = true;
+}
+
+bool AssetIndex::Postings(uint32_t trigram, const uint32_t*& first, const uint32_t*& last) const
+{
+	std::vector<uint32_t>::const_iterator it = std::lower_bound(index->trigrams.begin(), index->trigrams.end(), trigram);
+
+	if (it == index->trigrams.end() || *it != trigram)
+	{
+		return false;
+	}
+
+	size_t t = it - index->trigrams.begin();
+	first = index->ids.data() + index->offsets[t];
+	last = index->ids.data() + index->offsets[t + 1];
+	return true;
+}
+
+int AssetIndex::Query(const char* text, int maxResults, std::vector<int>& out)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	std::vector<std::string> terms;
+	std::string query = ToLower(text);
+	bool narrowed = false;
+
+	out.clear();
+
+	if (!index)
+	{
+		return 0;
+	}
+
+	for (size_t i = 0, end; i < query.size(); i = end + 1)
+	{
+		end = query.find(' ', i);
+		end = end == std::string::npos ? query.size() : end;
+
+		if (end > i)
+		{
+			terms.push_back(query.substr(i, end - i));
+		}
+	}
+
+	if (terms.empty())
+	{
+		return 0;
+	}
+
+	// Intersect the postings of every trigram in the query, which can only ever be a superset of
+	// the real matches
+	for (size_t t = 0; t < terms.size(); t++)
+	{
+		for (size_t c = 0; c + 3 <= terms[t].size(); c++)
+		{
+			const uint32_t* first;
+			const uint32_t* last;
+
+			if (!Postings(Trigram(&terms[t][c]), first, last))
+			{
+				querySeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+				return 0;
+			}
+
+			if (!narrowed)
+			{
+				candidates.assign(first, last);
+				narrowed = true;
+				continue;
+			}
+
+			scratch.clear();
+			std::set_intersection(candidates.begin(), candidates.end(), first, last, std::back_inserter(scratch));
+			candidates.swap(scratch);
+		}
+	}
+
+	if (!narrowed)
+	{
+		// Nothing long enough to have a trigram, so everything is a candidate
+		candidates.resize(index->paths.size());
+
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			candidates[i] = (uint32_t)i;
+		}
+	}
+
+	// Check the terms really are there, preferring matches in the file name over the directories
+	std::vector<std::pair<int, int> > matches;
+
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		const std::string& path = index->lower[candidates[i]];
+		size_t slash = path.find_last_of('/');
+		size_t nameStart = slash == std::string::npos ? 0 : slash + 1;
+		int score = (int)path.size();
+		size_t t;
+
+		for (t = 0; t < terms.size(); t++)
+		{
+			size_t at = path.find(terms[t]);
+
+			if (at == std::string::npos)
+			{
+				break;
+			}
+
+			if (at < nameStart && path.find(terms[t], nameStart) == std::string::npos)
+			{
+				score += 1000;
+			}
+		}
+
+		if (t == terms.size())
+		{
+			matches.push_back(std::make_pair(score, (int)candidates[i]));
+		}
+	}
+
+	size_t keep = std::min(matches.size(), (size_t)maxResults);
+	std::partial_sort(matches.begin(), matches.begin() + keep, matches.end());
+
+	for (size_t i = 0; i < keep; i++)
+	{
+		out.push_back(matches[i].second);
+	}
+
+	querySeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return (int)matches.size();
+}
@@ -1,50 +1,120 @@
 #include "AtariObj.h"
 
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
-
 #include <stdlib.h>
+#include <string.h>
+
+#include "MemTrack.h"
+#include "Trace.h"
 
-AtariObj::AtariObj(char* filename)
+AtariObj::AtariObj()
 {
-	o = loadObj(filename);
-    SetupBuffers();
+    memset(&o, 0, sizeof(o));
+    rayBench.rays = 0;
+
+    frustumCull = true;
+    backfaceCull = false;
+    pvsCull = true;
+    showLighting = false;
+    eyeLeaf = -1;
+    nodeVisLeaf = -1;
+
+    lightChanged = false;
+    slot.baseVertex = slot.vertCount = slot.firstIndex = slot.indexCount = slot.indicesReady = 0;
 }
 
-void AtariObj::SetupBuffers()
+AtariObj::~AtariObj()
 {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    MemTrack::Sub(MEM_LOADER, ObjBytes(o));
+    free(o.verts);
+    free(o.indices);
+}
+
+bool AtariObj::Load(char* filename, bool buildVis, BuildProgress* progress)
+{
+    TRACE_SCOPE("AtariObj::Load");
+
+    if (progress)
+    {
+        progress->Begin("Loading", 0);
+    }
+
+    {
+        TRACE_SCOPE("loadObj");
+        MemScope mem(MEM_LOADER);
+        o = loadObj(filename);
+        MemTrack::Add(MEM_LOADER, ObjBytes(o));
+    }
+
+    bsp.progress = portals.progress = vis.progress = progress;
+    bsp.Build(o);
+
+    if (buildVis)
+    {
+        portals.Build(bsp);
+        vis.Build(bsp, portals);
+    }
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    bsp.progress = portals.progress = vis.progress = NULL;
 
-    // Atari verts are in 16.16 fixed point format, so we need to convert them here to the correct format for OpenGL
-    float* fpVerts = (float*)malloc(sizeof(float) * 3 * o.vertCount);
+    if (progress)
+    {
+        if (progress->Cancelled())
+        {
+            return false;
+        }
+
+        progress->Begin("Building collision", 0);
+    }
 
-    for (int i = 0; i < o.vertCount; i++)
+    collide.Build(bsp);
+
+    return true;
+}
+
+bool AtariObj::BakeLighting(BuildProgress* progress)
+{
+    light.progress = progress;
+    light.Bake(bsp, collide, bakedLight);
+    light.progress = NULL;
+
+    if (progress && progress->Cancelled())
     {
-        fpVerts[i * 3 + 0] = (o.verts[i].x / 65536.0f);
-        fpVerts[i * 3 + 1] = (o.verts[i].y / 65536.0f);
-        fpVerts[i * 3 + 2] = (o.verts[i].z / 65536.0f);
+        std::vector<unsigned char>().swap(bakedLight);
+        return false;
     }
 
-    glBufferData(GL_ARRAY_BUFFER, o.vertCount * sizeof(float) * 3, fpVerts, GL_STATIC_DRAW);
+    return true;
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, o.indexCount * sizeof(long), o.indices, GL_STATIC_DRAW);
+void AtariObj::ApplyLighting()
+{
+    bsp.vertLight.swap(bakedLight);
+    std::vector<unsigned char>().swap(bakedLight);
 
-    // vertex positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
-    glBindVertexArray(0);
+    lightChanged = true;
+    showLighting = true;
 }
 
-void AtariObj::Render()
+void AtariObj::Cull(const glm::mat4& mvp, const glm::vec3& eye)
 {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, o.indexCount, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    BspFrustum frustum(&mvp[0][0]);
+    BspVec eyeFixed = { (fix16)(eye.x * 65536.0f), (fix16)(eye.y * 65536.0f), (fix16)(eye.z * 65536.0f) };
+
+    const unsigned char* visibleNodes = NULL;
+
+    eyeLeaf = bsp.FindLeaf(eyeFixed);
+
+    if (pvsCull && !bsp.visData.empty())
+    {
+        // The PVS only changes when the camera moves into a different leaf
+        if (eyeLeaf != nodeVisLeaf)
+        {
+            bsp.MarkVisibleNodes(eyeLeaf, nodeVis);
+            nodeVisLeaf = eyeLeaf;
+        }
+
+        visibleNodes = nodeVis.data();
+    }
+
+    bsp.CollectVisible(frustum, eyeFixed, frustumCull, backfaceCull, visibleNodes, ranges, cullStats);
 }
@@ -0,0 +1,713 @@
+#include "BspCollide.h"
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <emmintrin.h>
+
+#include "MemTrack.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+#define TRACE_EPSILON 0.0001f
+#define TRACE_EPSILON_FIXED 8
+#define MORTON_BITS 10
+#define BATCH_TILE 1024
+
+struct TraceItem
+{
+	int child;
+	float f1, f2;
+	int plane;		// node * 2 + side of the plane that started this piece, -1 for the very start
+};
+
+struct TraceItemFixed
+{
+	int child;
+	fix16 f1, f2;
+	int plane;
+};
+
+// Kept as plain arrays rather than __m128 so the stack doesn't need aligned allocation
+struct TraceItemPacket
+{
+	int child;
+	int mask;		// lanes still walking this piece
+	float f1[4], f2[4];
+	int plane[4];
+};
+
+static uint32_t Spread(uint32_t v)
+{
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+
+	return v;
+}
+
+static int BitCount(int mask)
+{
+	return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+}
+
+static uint32_t NextRandom(uint32_t& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 8;
+}
+
+BspCollide::BspCollide()
+{
+	tree = NULL;
+	maxDepth = 0;
+	threadCount = HardwareThreads();
+	sortBatches = false;
+
+	for (int i = 0; i < 3; i++)
+	{
+		boundsMin[i] = boundsMax[i] = 0.0f;
+	}
+}
+
+void BspCollide::Build(const BspTree& t)
+{
+	TRACE_SCOPE("BspCollide::Build");
+	MemScope mem(MEM_COLLIDE);
+	std::vector<int> depth(t.nodes.size(), 0);
+
+	tree = &t;
+	nodes.resize(t.nodes.size());
+	solid.resize(t.leaves.size());
+	maxDepth = 0;
+
+	// Planes go inline with the nodes so a trace only ever touches one array
+	for (size_t i = 0; i < t.nodes.size(); i++)
+	{
+		const BspPlane& p = t.planes[t.nodes[i].plane];
+		double len = sqrt((double)p.nx * p.nx + (double)p.ny * p.ny + (double)p.nz * p.nz);
+		Node& n = nodes[i];
+
+		n.nx = (float)(p.nx / len);
+		n.ny = (float)(p.ny / len);
+		n.nz = (float)(p.nz / len);
+		n.d = (float)(p.d / len);
+		n.children[0] = t.nodes[i].front;
+		n.children[1] = t.nodes[i].back;
+
+		for (int c = 0; c < 2; c++)
+		{
+			if (n.children[c] >= 0)
+			{
+				depth[n.children[c]] = depth[i] + 1;
+			}
+		}
+
+		maxDepth = std::max(maxDepth, depth[i] + 1);
+	}
+
+	for (size_t i = 0; i < t.leaves.size(); i++)
+	{
+		solid[i] = t.leaves[i].contents == BSP_SOLID;
+	}
+
+	if (!t.nodes.empty())
+	{
+		const BspBounds& b = t.nodes[0].bounds;
+
+		boundsMin[0] = b.min.x / 65536.0f;
+		boundsMin[1] = b.min.y / 65536.0f;
+		boundsMin[2] = b.min.z / 65536.0f;
+		boundsMax[0] = b.max.x / 65536.0f;
+		boundsMax[1] = b.max.y / 65536.0f;
+		boundsMax[2] = b.max.z / 65536.0f;
+	}
+}
+
+int BspCollide::PointContents(const float* p) const
+{
+	int child = nodes.empty() ? BSP_LEAF(0) : 0;
+
+	while (child >= 0)
+	{
+		const Node& n = nodes[child];
+		child = n.children[n.nx * p[0] + n.ny * p[1] + n.nz * p[2] - n.d < 0.0f];
+	}
+
+	return tree->leaves[BSP_LEAF(child)].contents;
+}
+
+int BspCollide::PointContents(const BspVec& p) const
+{
+	return tree->leaves[tree->FindLeaf(p)].contents;
+}
+
+bool BspCollide::Trace(const float* start, const float* end, float radius, BspHit& hit) const
+{
+	static thread_local std::vector<TraceItem> stack;
+	float dir[3] = { end[0] - start[0], end[1] - start[1], end[2] - start[2] };
+	float best = 1.0f;
+	int bestPlane = -1;
+	bool any = false;
+	int top = 0;
+
+	// A trace holds at most one pending piece per level of the tree
+	if (stack.size() < (size_t)maxDepth + 2)
+	{
+		stack.resize(maxDepth + 2);
+	}
+
+	TraceItem first = { nodes.empty() ? BSP_LEAF(0) : 0, 0.0f, 1.0f, -1 };
+	stack[top++] = first;
+
+	while (top > 0)
+	{
+		TraceItem item = stack[--top];
+		int child = item.child;
+
+		if (any && item.f1 >= best)
+		{
+			continue;
+		}
+
+		while (child >= 0)
+		{
+			const Node& n = nodes[child];
+			float ds = n.nx * start[0] + n.ny * start[1] + n.nz * start[2] - n.d;
+			float dd = n.nx * dir[0] + n.ny * dir[1] + n.nz * dir[2];
+			float d1 = ds + dd * item.f1;
+			float d2 = ds + dd * item.f2;
+
+			if (d1 >= radius && d2 >= radius)
+			{
+				child = n.children[0];
+				continue;
+			}
+
+			if (d1 < -radius && d2 < -radius)
+			{
+				child = n.children[1];
+				continue;
+			}
+
+			// Crosses the plane, or passes within radius of it: near side first, then the far side
+			// from the point where we could first touch the plane
+			int side;
+			float nearFrac, farFrac;
+
+			if (d1 < d2)
+			{
+				float inv = 1.0f / (d1 - d2);
+				side = 1;
+				nearFrac = (d1 - radius + TRACE_EPSILON) * inv;
+				farFrac = (d1 + radius + TRACE_EPSILON) * inv;
+			}
+			else if (d1 > d2)
+			{
+				float inv = 1.0f / (d1 - d2);
+				side = 0;
+				nearFrac = (d1 + radius + TRACE_EPSILON) * inv;
+				farFrac = (d1 - radius - TRACE_EPSILON) * inv;
+			}
+			else
+			{
+				side = d1 < 0.0f;
+				nearFrac = 1.0f;
+				farFrac = 0.0f;
+			}
+
+			nearFrac = std::min(std::max(nearFrac, 0.0f), 1.0f);
+			farFrac = std::min(std::max(farFrac, 0.0f), 1.0f);
+
+			TraceItem farItem = { n.children[side ^ 1], item.f1 + (item.f2 - item.f1) * farFrac, item.f2, child * 2 + side };
+			stack[top++] = farItem;
+
+			item.f2 = item.f1 + (item.f2 - item.f1) * nearFrac;
+			child = n.children[side];
+		}
+
+		if (solid[BSP_LEAF(child)] && (!any || item.f1 < best))
+		{
+			best = item.f1;
+			bestPlane = item.plane;
+			any = true;
+		}
+	}
+
+	FillHit(any, best, bestPlane, hit);
+
+	return any;
+}
+
+void BspCollide::FillHit(bool any, float fraction, int plane, BspHit& hit) const
+{
+	hit.fraction = any ? fraction : 1.0f;
+	hit.startSolid = any && plane < 0;
+	hit.normal[0] = hit.normal[1] = hit.normal[2] = 0.0f;
+
+	if (any && plane >= 0)
+	{
+		const Node& n = nodes[plane >> 1];
+		float sign = (plane & 1) ? -1.0f : 1.0f;
+
+		hit.normal[0] = n.nx * sign;
+		hit.normal[1] = n.ny * sign;
+		hit.normal[2] = n.nz * sign;
+	}
+}
+
+int BspCollide::TracePacket(const BspRay* rays, float radius, BspHit* hits) const
+{
+	static thread_local std::vector<TraceItemPacket> stack;
+	int top = 0;
+
+	if (stack.size() < (size_t)maxDepth + 2)
+	{
+		stack.resize(maxDepth + 2);
+	}
+
+	// Rays go across the lanes, one register per component
+	__m128 sx = _mm_setr_ps(rays[0].start[0], rays[1].start[0], rays[2].start[0], rays[3].start[0]);
+	__m128 sy = _mm_setr_ps(rays[0].start[1], rays[1].start[1], rays[2].start[1], rays[3].start[1]);
+	__m128 sz = _mm_setr_ps(rays[0].start[2], rays[1].start[2], rays[2].start[2], rays[3].start[2]);
+	__m128 dx = _mm_sub_ps(_mm_setr_ps(rays[0].end[0], rays[1].end[0], rays[2].end[0], rays[3].end[0]), sx);
+	__m128 dy = _mm_sub_ps(_mm_setr_ps(rays[0].end[1], rays[1].end[1], rays[2].end[1], rays[3].end[1]), sy);
+	__m128 dz = _mm_sub_ps(_mm_setr_ps(rays[0].end[2], rays[1].end[2], rays[2].end[2], rays[3].end[2]), sz);
+	__m128 rad = _mm_set1_ps(radius);
+	__m128 negRad = _mm_set1_ps(-radius);
+	__m128 eps = _mm_set1_ps(TRACE_EPSILON);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+
+	// Anything past 1 means no hit yet
+	__m128 best = _mm_set1_ps(2.0f);
+	__m128i bestPlane = _mm_set1_epi32(-1);
+
+	TraceItemPacket first = { nodes.empty() ? BSP_LEAF(0) : 0, 15, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { -1, -1, -1, -1 } };
+	stack[top++] = first;
+
+	while (top > 0)
+	{
+		const TraceItemPacket& item = stack[--top];
+		int child = item.child;
+		__m128 f1 = _mm_loadu_ps(item.f1);
+		__m128 f2 = _mm_loadu_ps(item.f2);
+		__m128i plane = _mm_loadu_si128((const __m128i*)item.plane);
+
+		// Lanes that already hit something closer than this piece drop out
+		int mask = item.mask & _mm_movemask_ps(_mm_cmplt_ps(f1, best));
+
+		while (mask && child >= 0)
+		{
+			const Node& n = nodes[child];
+			__m128 nx = _mm_set1_ps(n.nx), ny = _mm_set1_ps(n.ny), nz = _mm_set1_ps(n.nz);
+			__m128 ds = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sx), _mm_mul_ps(ny, sy)), _mm_mul_ps(nz, sz)), _mm_set1_ps(n.d));
+			__m128 dd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, dx), _mm_mul_ps(ny, dy)), _mm_mul_ps(nz, dz));
+			__m128 d1 = _mm_add_ps(ds, _mm_mul_ps(dd, f1));
+			__m128 d2 = _mm_add_ps(ds, _mm_mul_ps(dd, f2));
+
+			int frontOnly = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(d1, rad), _mm_cmpge_ps(d2, rad))) & mask;
+			int backOnly = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(d1, negRad), _mm_cmplt_ps(d2, negRad))) & mask;
+
+			if (frontOnly == mask)
+			{
+				child = n.children[0];
+				continue;
+			}
+
+			if (backOnly == mask)
+			{
+				child = n.children[1];
+				continue;
+			}
+
+			// Same split as a single trace, done for every lane at once: side is the child each
+			// lane reaches first, near and far the fractions it leaves and re-enters the plane at
+			__m128 backFirst = _mm_or_ps(_mm_cmplt_ps(d1, d2), _mm_and_ps(_mm_cmpeq_ps(d1, d2), _mm_cmplt_ps(d1, zero)));
+			__m128 parallel = _mm_cmpeq_ps(d1, d2);
+			__m128 inv = _mm_div_ps(one, _mm_sub_ps(d1, d2));
+			__m128 nearBack = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(d1, rad), eps), inv);
+			__m128 farBack = _mm_mul_ps(_mm_add_ps(_mm_add_ps(d1, rad), eps), inv);
+			__m128 nearFront = _mm_mul_ps(_mm_add_ps(_mm_add_ps(d1, rad), eps), inv);
+			__m128 farFront = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(d1, rad), eps), inv);
+			__m128 nearFrac = _mm_or_ps(_mm_and_ps(backFirst, nearBack), _mm_andnot_ps(backFirst, nearFront));
+			__m128 farFrac = _mm_or_ps(_mm_and_ps(backFirst, farBack), _mm_andnot_ps(backFirst, farFront));
+
+			nearFrac = _mm_or_ps(_mm_and_ps(parallel, one), _mm_andnot_ps(parallel, nearFrac));
+			farFrac = _mm_andnot_ps(parallel, farFrac);
+			nearFrac = _mm_min_ps(_mm_max_ps(nearFrac, zero), one);
+			farFrac = _mm_min_ps(_mm_max_ps(farFrac, zero), one);
+
+			__m128 span = _mm_sub_ps(f2, f1);
+			__m128 nearEnd = _mm_add_ps(f1, _mm_mul_ps(span, nearFrac));
+			__m128 farStart = _mm_add_ps(f1, _mm_mul_ps(span, farFrac));
+
+			// Lanes wholly on one side keep their piece, crossing lanes take their near piece
+			// into their first child and their far piece into the other
+			int cross = mask & ~frontOnly & ~backOnly;
+			int crossBack = _mm_movemask_ps(backFirst) & cross;
+			int crossFront = cross & ~crossBack;
+			__m128 toBack = _mm_castsi128_ps(_mm_setr_epi32(crossBack & 1 ? -1 : 0, crossBack & 2 ? -1 : 0, crossBack & 4 ? -1 : 0, crossBack & 8 ? -1 : 0));
+			__m128 toFront = _mm_castsi128_ps(_mm_setr_epi32(crossFront & 1 ? -1 : 0, crossFront & 2 ? -1 : 0, crossFront & 4 ? -1 : 0, crossFront & 8 ? -1 : 0));
+			__m128i farPlaneFront = _mm_set1_epi32(child * 2 + 1);
+			__m128i farPlaneBack = _mm_set1_epi32(child * 2);
+
+			// Front child: near pieces of front-first lanes, far pieces of back-first ones
+			__m128 frontF1 = _mm_or_ps(_mm_and_ps(toBack, farStart), _mm_andnot_ps(toBack, f1));
+			__m128 frontF2 = _mm_or_ps(_mm_and_ps(toFront, nearEnd), _mm_andnot_ps(toFront, f2));
+			__m128i frontPlane = _mm_or_si128(_mm_and_si128(_mm_castps_si128(toBack), farPlaneFront), _mm_andnot_si128(_mm_castps_si128(toBack), plane));
+			__m128 backF1 = _mm_or_ps(_mm_and_ps(toFront, farStart), _mm_andnot_ps(toFront, f1));
+			__m128 backF2 = _mm_or_ps(_mm_and_ps(toBack, nearEnd), _mm_andnot_ps(toBack, f2));
+			__m128i backPlane = _mm_or_si128(_mm_and_si128(_mm_castps_si128(toFront), farPlaneBack), _mm_andnot_si128(_mm_castps_si128(toFront), plane));
+			int frontMask = frontOnly | cross;
+			int backMask = backOnly | cross;
+
+			// Go where most lanes go first, so they find their hits before the rest is walked
+			int frontVotes = frontOnly | crossFront;
+			int backVotes = backOnly | crossBack;
+			bool frontFirst = BitCount(frontVotes) >= BitCount(backVotes);
+			TraceItemPacket& later = stack[top++];
+
+			later.child = n.children[frontFirst];
+			later.mask = frontFirst ? backMask : frontMask;
+			_mm_storeu_ps(later.f1, frontFirst ? backF1 : frontF1);
+			_mm_storeu_ps(later.f2, frontFirst ? backF2 : frontF2);
+			_mm_storeu_si128((__m128i*)later.plane, frontFirst ? backPlane : frontPlane);
+
+			child = n.children[!frontFirst];
+			mask = frontFirst ? frontMask : backMask;
+			f1 = frontFirst ? frontF1 : backF1;
+			f2 = frontFirst ? frontF2 : backF2;
+			plane = frontFirst ? frontPlane : backPlane;
+		}
+
+		if (mask && solid[BSP_LEAF(child)])
+		{
+			__m128 closer = _mm_cmplt_ps(f1, best);
+			__m128 lanes = _mm_castsi128_ps(_mm_setr_epi32(mask & 1 ? -1 : 0, mask & 2 ? -1 : 0, mask & 4 ? -1 : 0, mask & 8 ? -1 : 0));
+			__m128 take = _mm_and_ps(closer, lanes);
+
+			best = _mm_or_ps(_mm_and_ps(take, f1), _mm_andnot_ps(take, best));
+			bestPlane = _mm_or_si128(_mm_and_si128(_mm_castps_si128(take), plane), _mm_andnot_si128(_mm_castps_si128(take), bestPlane));
+		}
+	}
+
+	float bestOut[4];
+	int planeOut[4];
+	int hitMask = 0;
+
+	_mm_storeu_ps(bestOut, best);
+	_mm_storeu_si128((__m128i*)planeOut, bestPlane);
+
+	for (int i = 0; i < 4; i++)
+	{
+		bool any = bestOut[i] <= 1.0f;
+
+		FillHit(any, bestOut[i], planeOut[i], hits[i]);
+		hitMask |= any << i;
+	}
+
+	return hitMask;
+}
+
+bool BspCollide::Trace(const BspVec& start, const BspVec& end, fix16 radius, BspHitFixed& hit) const
+{
+	static thread_local std::vector<TraceItemFixed> stack;
+	int64_t dir[3] = { (int64_t)end.x - start.x, (int64_t)end.y - start.y, (int64_t)end.z - start.z };
+	fix16 best = FIX_ONE;
+	int bestPlane = -1;
+	bool any = false;
+	int top = 0;
+
+	if (stack.size() < (size_t)maxDepth + 2)
+	{
+		stack.resize(maxDepth + 2);
+	}
+
+	TraceItemFixed first = { nodes.empty() ? BSP_LEAF(0) : 0, 0, FIX_ONE, -1 };
+	stack[top++] = first;
+
+	while (top > 0)
+	{
+		TraceItemFixed item = stack[--top];
+		int child = item.child;
+
+		if (any && item.f1 >= best)
+		{
+			continue;
+		}
+
+		while (child >= 0)
+		{
+			const BspPlane& p = tree->planes[tree->nodes[child].plane];
+			int64_t ds = tree->Distance(p, start);
+			int64_t dd = (p.nx * dir[0] + p.ny * dir[1] + p.nz * dir[2]) >> 16;
+			int64_t d1 = ds + ((dd * item.f1) >> 16);
+			int64_t d2 = ds + ((dd * item.f2) >> 16);
+
+			if (d1 >= radius && d2 >= radius)
+			{
+				child = tree->nodes[child].front;
+				continue;
+			}
+
+			if (d1 < -radius && d2 < -radius)
+			{
+				child = tree->nodes[child].back;
+				continue;
+			}
+
+			int side;
+			int64_t nearFrac, farFrac;
+
+			if (d1 < d2)
+			{
+				side = 1;
+				nearFrac = (d1 - radius + TRACE_EPSILON_FIXED) * FIX_ONE / (d1 - d2);
+				farFrac = (d1 + radius + TRACE_EPSILON_FIXED) * FIX_ONE / (d1 - d2);
+			}
+			else if (d1 > d2)
+			{
+				side = 0;
+				nearFrac = (d1 + radius + TRACE_EPSILON_FIXED) * FIX_ONE / (d1 - d2);
+				farFrac = (d1 - radius - TRACE_EPSILON_FIXED) * FIX_ONE / (d1 - d2);
+			}
+			else
+			{
+				side = d1 < 0;
+				nearFrac = FIX_ONE;
+				farFrac = 0;
+			}
+
+			nearFrac = std::min<int64_t>(std::max<int64_t>(nearFrac, 0), FIX_ONE);
+			farFrac = std::min<int64_t>(std::max<int64_t>(farFrac, 0), FIX_ONE);
+
+			const BspNode& n = tree->nodes[child];
+			TraceItemFixed farItem = { side ? n.front : n.back, (fix16)(item.f1 + (((int64_t)(item.f2 - item.f1) * farFrac) >> 16)), item.f2, child * 2 + side };
+			stack[top++] = farItem;
+
+			item.f2 = (fix16)(item.f1 + (((int64_t)(item.f2 - item.f1) * nearFrac) >> 16));
+			child = side ? n.back : n.front;
+		}
+
+		if (solid[BSP_LEAF(child)] && (!any || item.f1 < best))
+		{
+			best = item.f1;
+			bestPlane = item.plane;
+			any = true;
+		}
+	}
+
+	hit.fraction = any ? best : FIX_ONE;
+	hit.startSolid = any && bestPlane < 0;
+	hit.plane = bestPlane >= 0 ? tree->nodes[bestPlane >> 1].plane : -1;
+	hit.flipped = bestPlane >= 0 && (bestPlane & 1);
+
+	return any;
+}
+
+void BspCollide::TraceBatch(const BspRay* rays, int count, float radius, BspHit* hits) const
+{
+	TRACE_SCOPE("BspCollide::TraceBatch");
+	std::vector<uint32_t> order(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		order[i] = i;
+	}
+
+	if (sortBatches)
+	{
+		SortRays(rays, count, order);
+	}
+
+	// Tiles of neighbouring rays go out to every core
+	int tiles = (count + BATCH_TILE - 1) / BATCH_TILE;
+
+	ParallelFor(tiles, threadCount, [&](int tile)
+	{
+		int end = std::min(count, (tile + 1) * BATCH_TILE);
+
+		for (int i = tile * BATCH_TILE; i < end; i += 4)
+		{
+			int group = std::min(4, end - i);
+			BspRay packet[4];
+			BspHit packetHits[4];
+			int octant = 0;
+			bool sameOctant = true;
+
+			for (int k = 0; k < group; k++)
+			{
+				packet[k] = rays[order[i + k]];
+
+				int o = (packet[k].end[0] < packet[k].start[0]) | (packet[k].end[1] < packet[k].start[1]) << 1 | (packet[k].end[2] < packet[k].start[2]) << 2;
+				octant = k ? octant : o;
+				sameOctant &= o == octant;
+			}
+
+			// Packets only pay off when the rays head the same way, scattered ones go one at a time
+			if (group == 4 && sameOctant)
+			{
+				TracePacket(packet, radius, packetHits);
+
+				for (int k = 0; k < 4; k++)
+				{
+					hits[order[i + k]] = packetHits[k];
+				}
+
+				continue;
+			}
+
+			for (int k = 0; k < group; k++)
+			{
+				Trace(packet[k].start, packet[k].end, radius, hits[order[i + k]]);
+			}
+		}
+	});
+}
+
+void BspCollide::SortRays(const BspRay* rays, int count, std::vector<uint32_t>& order) const
+{
+	std::vector<uint32_t> keys(count), sorted(count);
+	std::vector<int> buckets(1 << MORTON_BITS);
+	float scale[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		float size = boundsMax[i] - boundsMin[i];
+		scale[i] = size > 0.0f ? ((1 << MORTON_BITS) - 1) / size : 0.0f;
+	}
+
+	// Rays starting close together walk mostly the same nodes, so sorting them along a
+	// Morton curve keeps those nodes in cache from one ray to the next
+	for (int i = 0; i < count; i++)
+	{
+		uint32_t key = 0;
+
+		for (int a = 0; a < 3; a++)
+		{
+			float q = (rays[i].start[a] - boundsMin[a]) * scale[a];
+			uint32_t c = (uint32_t)std::min(std::max(q, 0.0f), (float)((1 << MORTON_BITS) - 1));
+			key |= Spread(c) << a;
+		}
+
+		keys[i] = key;
+	}
+
+	// Three radix passes over the 30 bit keys, much cheaper than a comparison sort at these sizes
+	for (int shift = 0; shift < MORTON_BITS * 3; shift += MORTON_BITS)
+	{
+		std::fill(buckets.begin(), buckets.end(), 0);
+
+		for (int i = 0; i < count; i++)
+		{
+			buckets[(keys[order[i]] >> shift) & ((1 << MORTON_BITS) - 1)]++;
+		}
+
+		for (int b = 0, total = 0; b < (1 << MORTON_BITS); b++)
+		{
+			int c = buckets[b];
+			buckets[b] = total;
+			total += c;
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			sorted[buckets[(keys[order[i]] >> shift) & ((1 << MORTON_BITS) - 1)]++] = order[i];
+		}
+
+		order.swap(sorted);
+	}
+}
+
+void BspCollide::Benchmark(int rayCount, BspRayBench& out) const
+{
+	std::vector<BspRay> rays(rayCount);
+	std::vector<BspVec> fixedRays(rayCount * 2);
+	std::vector<BspRay> bundles(rayCount & ~3);
+	std::vector<BspHit> hits(rayCount);
+	uint32_t seed = 12345;
+	float lo[3], size[3];
+	BspHit hit;
+	BspHitFixed fixedHit;
+
+	// Rays run between random points in a box a little larger than the model
+	for (int a = 0; a < 3; a++)
+	{
+		float margin = (boundsMax[a] - boundsMin[a]) * 0.25f + 0.01f;
+		lo[a] = boundsMin[a] - margin;
+		size[a] = boundsMax[a] - boundsMin[a] + margin * 2.0f;
+	}
+
+	for (int i = 0; i < rayCount; i++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			rays[i].start[a] = lo[a] + size[a] * (NextRandom(seed) & 0xFFFF) / 65535.0f;
+			rays[i].end[a] = lo[a] + size[a] * (NextRandom(seed) & 0xFFFF) / 65535.0f;
+		}
+
+		BspVec s = { (fix16)(rays[i].start[0] * 65536.0f), (fix16)(rays[i].start[1] * 65536.0f), (fix16)(rays[i].start[2] * 65536.0f) };
+		BspVec e = { (fix16)(rays[i].end[0] * 65536.0f), (fix16)(rays[i].end[1] * 65536.0f), (fix16)(rays[i].end[2] * 65536.0f) };
+		fixedRays[i * 2] = s;
+		fixedRays[i * 2 + 1] = e;
+	}
+
+	// Bundles of four rays leaving almost the same point in almost the same direction, the way
+	// a baker samples around a vertex
+	for (size_t i = 0; i < bundles.size(); i += 4)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				bundles[i + k].start[a] = rays[i].start[a] + size[a] * 0.01f * (NextRandom(seed) & 0xFFFF) / 65535.0f;
+				bundles[i + k].end[a] = rays[i].end[a] + size[a] * 0.05f * (NextRandom(seed) & 0xFFFF) / 65535.0f;
+			}
+		}
+	}
+
+	out.rays = rayCount;
+	out.hits = 0;
+
+	std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < rayCount; i++)
+	{
+		out.hits += Trace(rays[i].start, rays[i].end, 0.0f, hit);
+	}
+
+	std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < rayCount; i++)
+	{
+		Trace(fixedRays[i * 2], fixedRays[i * 2 + 1], 0, fixedHit);
+	}
+
+	std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+
+	TraceBatch(rays.data(), rayCount, 0.0f, hits.data());
+
+	std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+
+	for (size_t i = 0; i < bundles.size(); i++)
+	{
+		Trace(bundles[i].start, bundles[i].end, 0.0f, hit);
+	}
+
+	std::chrono::high_resolution_clock::time_point t4 = std::chrono::high_resolution_clock::now();
+
+	for (size_t i = 0; i < bundles.size(); i += 4)
+	{
+		TracePacket(&bundles[i], 0.0f, &hits[i]);
+	}
+
+	std::chrono::high_resolution_clock::time_point t5 = std::chrono::high_resolution_clock::now();
+
+	out.floatMRays = rayCount / std::chrono::duration<double>(t1 - t0).count() / 1.0e6;
+	out.fixedMRays = rayCount / std::chrono::duration<double>(t2 - t1).count() / 1.0e6;
+	out.batchMRays = rayCount / std::chrono::duration<double>(t3 - t2).count() / 1.0e6;
+	out.coherentMRays = bundles.size() / std::chrono::duration<double>(t4 - t3).count() / 1.0e6;
+	out.packetMRays = bundles.size() / std::chrono::duration<double>(t5 - t4).count() / 1.0e6;
+}
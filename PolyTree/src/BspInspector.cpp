@@ -0,0 +1,293 @@
+#include "BspInspector.h"
+
+#include <stdio.h>
+
+#include "imgui.h"
+
+static const char* const nodeHeaders[] = { "Node", "Plane", "Front", "Back", "Triangles", "Subtree", "Bounds" };
+static const char* const planeHeaders[] = { "Plane", "Normal", "Distance", "Raw 16.16" };
+static const char* const triHeaders[] = { "Triangle", "Node", "Verts", "First Vert" };
+
+static float ToFloat(fix16 f)
+{
+	return f / 65536.0f;
+}
+
+static void ChildText(const BspTree& tree, int child)
+{
+	if (child >= 0)
+	{
+		ImGui::Text("%i", child);
+		return;
+	}
+
+	int leaf = BSP_LEAF(child);
+	ImGui::Text("leaf %i (%s)", leaf, tree.leaves[leaf].contents == BSP_SOLID ? "solid" : "empty");
+}
+
+BspInspector::BspInspector()
+{
+	open = false;
+	selectedNode = -1;
+	triNodesTree = NULL;
+	triNodesCount = 0;
+
+	for (int i = 0; i < TABLE_COUNT; i++)
+	{
+		gotoRow[i] = 0;
+		scrollTo[i] = -1;
+	}
+}
+
+void BspInspector::Draw(const BspTree& tree)
+{
+	if (!open)
+	{
+		return;
+	}
+
+	ImGui::SetNextWindowSize(ImVec2(700, 400), ImGuiCond_FirstUseEver);
+
+	if (!ImGui::Begin("BSP Inspector", &open))
+	{
+		ImGui::End();
+		return;
+	}
+
+	if (selectedNode >= (int)tree.nodes.size())
+	{
+		selectedNode = -1;
+	}
+
+	if (ImGui::BeginTabBar("Tables"))
+	{
+		if (ImGui::BeginTabItem("Nodes"))
+		{
+			DrawNodes(tree);
+			ImGui::EndTabItem();
+		}
+
+		if (ImGui::BeginTabItem("Planes"))
+		{
+			DrawPlanes(tree);
+			ImGui::EndTabItem();
+		}
+
+		if (ImGui::BeginTabItem("Triangles"))
+		{
+			DrawTris(tree);
+			ImGui::EndTabItem();
+		}
+
+		ImGui::EndTabBar();
+	}
+
+	ImGui::End();
+}
+
+bool BspInspector::BeginTable(Table table, int rowCount, int columnCount, const char* const* headers)
+{
+	ImGui::Text("%i rows", rowCount);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(120);
+
+	if (ImGui::InputInt("Go To", &gotoRow[table], 1, 100, ImGuiInputTextFlags_EnterReturnsTrue))
+	{
+		scrollTo[table] = gotoRow[table];
+	}
+
+	gotoRow[table] = gotoRow[table] < 0 ? 0 : gotoRow[table];
+
+	if (!ImGui::BeginChild("Rows", ImVec2(0, 0), true))
+	{
+		ImGui::EndChild();
+		return false;
+	}
+
+	ImGui::Columns(columnCount, "Columns");
+
+	for (int i = 0; i < columnCount; i++)
+	{
+		ImGui::TextUnformatted(headers[i]);
+		ImGui::NextColumn();
+	}
+
+	ImGui::Separator();
+
+	if (scrollTo[table] >= 0 && rowCount > 0)
+	{
+		int row = scrollTo[table] < rowCount ? scrollTo[table] : rowCount - 1;
+		float y = ImGui::GetCursorPosY() + row * ImGui::GetTextLineHeightWithSpacing();
+
+		ImGui::SetScrollY(y - ImGui::GetWindowHeight() * 0.5f);
+		scrollTo[table] = -1;
+	}
+
+	return true;
+}
+
+void BspInspector::EndTable()
+{
+	ImGui::Columns(1);
+	ImGui::EndChild();
+}
+
+void BspInspector::SelectNode(const BspTree& tree, int node)
+{
+	selectedNode = node;
+
+	// Bring the node's plane and triangles into view on the other tabs
+	scrollTo[TABLE_PLANES] = gotoRow[TABLE_PLANES] = tree.nodes[node].plane;
+	scrollTo[TABLE_TRIS] = gotoRow[TABLE_TRIS] = tree.nodes[node].firstTri;
+}
+
+void BspInspector::DrawNodes(const BspTree& tree)
+{
+	int count = (int)tree.nodes.size();
+
+	if (!BeginTable(TABLE_NODES, count, 7, nodeHeaders))
+	{
+		return;
+	}
+
+	ImGuiListClipper clipper(count, ImGui::GetTextLineHeightWithSpacing());
+
+	while (clipper.Step())
+	{
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+		{
+			const BspNode& n = tree.nodes[i];
+			char label[16];
+
+			snprintf(label, sizeof(label), "%i", i);
+
+			if (ImGui::Selectable(label, selectedNode == i, ImGuiSelectableFlags_SpanAllColumns))
+			{
+				SelectNode(tree, i);
+			}
+
+			ImGui::NextColumn();
+			ImGui::Text("%i", n.plane);
+			ImGui::NextColumn();
+			ChildText(tree, n.front);
+			ImGui::NextColumn();
+			ChildText(tree, n.back);
+			ImGui::NextColumn();
+			ImGui::Text("%i +%i/%i", n.firstTri, n.frontTriCount, n.backTriCount);
+			ImGui::NextColumn();
+			ImGui::Text("%i nodes, %i tris", n.nodeEnd - i, n.triEnd - n.firstTri);
+			ImGui::NextColumn();
+			ImGui::Text("(%.2f %.2f %.2f) - (%.2f %.2f %.2f)", ToFloat(n.bounds.min.x), ToFloat(n.bounds.min.y), ToFloat(n.bounds.min.z),
+				ToFloat(n.bounds.max.x), ToFloat(n.bounds.max.y), ToFloat(n.bounds.max.z));
+			ImGui::NextColumn();
+		}
+	}
+
+	EndTable();
+}
+
+void BspInspector::DrawPlanes(const BspTree& tree)
+{
+	int count = (int)tree.planes.size();
+	int selectedPlane = selectedNode >= 0 ? tree.nodes[selectedNode].plane : -1;
+
+	if (!BeginTable(TABLE_PLANES, count, 4, planeHeaders))
+	{
+		return;
+	}
+
+	ImGuiListClipper clipper(count, ImGui::GetTextLineHeightWithSpacing());
+
+	while (clipper.Step())
+	{
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+		{
+			const BspPlane& p = tree.planes[i];
+			char label[16];
+
+			snprintf(label, sizeof(label), "%i", i);
+			ImGui::Selectable(label, selectedPlane == i, ImGuiSelectableFlags_SpanAllColumns);
+			ImGui::NextColumn();
+			ImGui::Text("%.4f %.4f %.4f", ToFloat(p.nx), ToFloat(p.ny), ToFloat(p.nz));
+			ImGui::NextColumn();
+			ImGui::Text("%.4f", ToFloat(p.d));
+			ImGui::NextColumn();
+			ImGui::Text("0x%08x 0x%08x 0x%08x 0x%08x", p.nx, p.ny, p.nz, p.d);
+			ImGui::NextColumn();
+		}
+	}
+
+	EndTable();
+}
+
+void BspInspector::UpdateTriNodes(const BspTree& tree)
+{
+	if (triNodesTree == &tree && triNodesCount == tree.nodes.size() && triNodes.size() == (size_t)tree.TriCount())
+	{
+		return;
+	}
+
+	triNodesTree = &tree;
+	triNodesCount = tree.nodes.size();
+	triNodes.assign(tree.TriCount(), -1);
+
+	for (int i = 0; i < (int)tree.nodes.size(); i++)
+	{
+		const BspNode& n = tree.nodes[i];
+
+		for (int t = n.firstTri; t < n.firstTri + n.frontTriCount + n.backTriCount; t++)
+		{
+			triNodes[t] = i;
+		}
+	}
+}
+
+void BspInspector::DrawTris(const BspTree& tree)
+{
+	int count = tree.TriCount();
+	int selectedFirst = -1, selectedEnd = -1;
+
+	UpdateTriNodes(tree);
+
+	if (selectedNode >= 0)
+	{
+		const BspNode& n = tree.nodes[selectedNode];
+		selectedFirst = n.firstTri;
+		selectedEnd = n.firstTri + n.frontTriCount + n.backTriCount;
+	}
+
+	if (!BeginTable(TABLE_TRIS, count, 4, triHeaders))
+	{
+		return;
+	}
+
+	ImGuiListClipper clipper(count, ImGui::GetTextLineHeightWithSpacing());
+
+	while (clipper.Step())
+	{
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+		{
+			const unsigned int* tri = &tree.indices[i * 3];
+			const BspVec& v = tree.verts[tri[0]];
+			char label[16];
+
+			snprintf(label, sizeof(label), "%i", i);
+
+			if (ImGui::Selectable(label, i >= selectedFirst && i < selectedEnd, ImGuiSelectableFlags_SpanAllColumns) && triNodes[i] >= 0)
+			{
+				selectedNode = triNodes[i];
+				scrollTo[TABLE_NODES] = gotoRow[TABLE_NODES] = selectedNode;
+			}
+
+			ImGui::NextColumn();
+			ImGui::Text("%i", triNodes[i]);
+			ImGui::NextColumn();
+			ImGui::Text("%u %u %u", tri[0], tri[1], tri[2]);
+			ImGui::NextColumn();
+			ImGui::Text("%.2f %.2f %.2f", ToFloat(v.x), ToFloat(v.y), ToFloat(v.z));
+			ImGui::NextColumn();
+		}
+	}
+
+	EndTable();
+}
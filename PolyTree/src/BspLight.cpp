@@ -0,0 +1,241 @@
+#include "BspLight.h"
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "MemTrack.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+#define BAKE_TILE 64
+#define BAKE_BIAS 0.001f		// of the model's size, so rays don't start inside their own surface
+#define BAKE_PI 3.14159265f
+
+static void Normalise(float* v)
+{
+	float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+	if (len > 0.0f)
+	{
+		v[0] /= len;
+		v[1] /= len;
+		v[2] /= len;
+	}
+}
+
+BspLight::BspLight()
+{
+	sunDir[0] = 0.4f;
+	sunDir[1] = 1.0f;
+	sunDir[2] = 0.3f;
+	sunIntensity = 0.7f;
+	ambientIntensity = 0.4f;
+	aoSamples = 32;
+	aoDistance = 0.2f;
+	threadCount = HardwareThreads();
+	bakeSeconds = 0.0;
+	raysCast = 0;
+	progress = NULL;
+}
+
+void BspLight::MakeHemisphere()
+{
+	int rings = (int)sqrtf((float)aoSamples);
+	int count = (aoSamples + 3) & ~3;
+
+	rings = std::max(rings, 1);
+	hemisphere.resize(count * 3);
+
+	// Cosine weighted and stratified over rings, so neighbouring samples point nearly the same way
+	// and go down the tree together in a packet
+	for (int i = 0; i < count; i++)
+	{
+		int ring = i * rings / count;
+		int perRing = (count + rings - 1) / rings;
+		float r = sqrtf((ring + 0.5f) / rings);
+		float a = 2.0f * BAKE_PI * ((i % perRing) + 0.5f * (ring & 1)) / perRing;
+
+		hemisphere[i * 3 + 0] = r * cosf(a);
+		hemisphere[i * 3 + 1] = r * sinf(a);
+		hemisphere[i * 3 + 2] = sqrtf(std::max(0.0f, 1.0f - r * r));
+	}
+}
+
+unsigned char BspLight::LightVert(int v, const BspCollide& collide, float size) const
+{
+	const Vert& vert = bakeVerts[v];
+	const float* n = vert.normal;
+	float start[3], t[3], b[3];
+	BspRay rays[4];
+	BspHit hits[4];
+
+	for (int a = 0; a < 3; a++)
+	{
+		start[a] = vert.pos[a] + n[a] * size * BAKE_BIAS;
+	}
+
+	// Any pair of axes perpendicular to the normal will do, spun a little per vert to break up banding
+	float spin = v * 2.39996f;
+	float cs = cosf(spin), sn = sinf(spin);
+	float up[3] = { fabsf(n[0]) < 0.9f ? 1.0f : 0.0f, fabsf(n[0]) < 0.9f ? 0.0f : 1.0f, 0.0f };
+
+	t[0] = up[1] * n[2] - up[2] * n[1];
+	t[1] = up[2] * n[0] - up[0] * n[2];
+	t[2] = up[0] * n[1] - up[1] * n[0];
+	Normalise(t);
+
+	b[0] = n[1] * t[2] - n[2] * t[1];
+	b[1] = n[2] * t[0] - n[0] * t[2];
+	b[2] = n[0] * t[1] - n[1] * t[0];
+
+	for (int a = 0; a < 3; a++)
+	{
+		float ta = t[a], ba = b[a];
+		t[a] = ta * cs + ba * sn;
+		b[a] = ba * cs - ta * sn;
+	}
+
+	// Occlusion falls off with how close the hit is
+	int count = (int)hemisphere.size() / 3;
+	float open = 0.0f;
+	float reach = size * aoDistance;
+
+	for (int i = 0; i < count; i += 4)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			const float* h = &hemisphere[(i + k) * 3];
+
+			for (int a = 0; a < 3; a++)
+			{
+				rays[k].start[a] = start[a];
+				rays[k].end[a] = start[a] + (t[a] * h[0] + b[a] * h[1] + n[a] * h[2]) * reach;
+			}
+		}
+
+		collide.TracePacket(rays, 0.0f, hits);
+
+		for (int k = 0; k < 4; k++)
+		{
+			open += hits[k].startSolid ? 0.0f : hits[k].fraction;
+		}
+	}
+
+	float light = ambientIntensity * open / count;
+	float facing = n[0] * sunDir[0] + n[1] * sunDir[1] + n[2] * sunDir[2];
+
+	if (facing > 0.0f)
+	{
+		float end[3] = { start[0] + sunDir[0] * size * 2.0f, start[1] + sunDir[1] * size * 2.0f, start[2] + sunDir[2] * size * 2.0f };
+		BspHit shadow;
+
+		if (!collide.Trace(start, end, 0.0f, shadow))
+		{
+			light += sunIntensity * facing;
+		}
+	}
+
+	return (unsigned char)(std::min(light, 1.0f) * 255.0f + 0.5f);
+}
+
+void BspLight::Bake(const BspTree& tree, const BspCollide& collide, std::vector<unsigned char>& out)
+{
+	TRACE_SCOPE("BspLight::Bake");
+	MemScope mem(MEM_COLLIDE);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	int vertCount = (int)tree.verts.size();
+	float size = 0.0f;
+
+	Normalise(sunDir);
+	MakeHemisphere();
+
+	// Smooth normals, each triangle adding its area weighted normal to its corners
+	bakeVerts.assign(vertCount, Vert());
+
+	for (int i = 0; i < vertCount; i++)
+	{
+		bakeVerts[i].pos[0] = tree.verts[i].x / 65536.0f;
+		bakeVerts[i].pos[1] = tree.verts[i].y / 65536.0f;
+		bakeVerts[i].pos[2] = tree.verts[i].z / 65536.0f;
+		bakeVerts[i].normal[0] = bakeVerts[i].normal[1] = bakeVerts[i].normal[2] = 0.0f;
+	}
+
+	for (size_t i = 0; i + 2 < tree.indices.size(); i += 3)
+	{
+		const float* a = bakeVerts[tree.indices[i]].pos;
+		const float* b = bakeVerts[tree.indices[i + 1]].pos;
+		const float* c = bakeVerts[tree.indices[i + 2]].pos;
+		float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float w[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float n[3] = { u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0] };
+
+		for (int k = 0; k < 3; k++)
+		{
+			float* vn = bakeVerts[tree.indices[i + k]].normal;
+
+			vn[0] += n[0];
+			vn[1] += n[1];
+			vn[2] += n[2];
+		}
+	}
+
+	for (int i = 0; i < vertCount; i++)
+	{
+		Normalise(bakeVerts[i].normal);
+	}
+
+	if (!tree.nodes.empty())
+	{
+		const BspBounds& b = tree.nodes[0].bounds;
+		float dx = (b.max.x - b.min.x) / 65536.0f, dy = (b.max.y - b.min.y) / 65536.0f, dz = (b.max.z - b.min.z) / 65536.0f;
+
+		size = sqrtf(dx * dx + dy * dy + dz * dz);
+	}
+
+	// Verts go out in tiles so threads grab a good run of nearby verts at a time without
+	// fighting over the counter
+	int tiles = (vertCount + BAKE_TILE - 1) / BAKE_TILE;
+	int hemisphereCount = (int)hemisphere.size() / 3;
+	std::atomic<long long> rays(0);
+
+	out.assign(vertCount, 0);
+
+	if (progress)
+	{
+		progress->Begin("Baking lighting", tiles);
+	}
+
+	ParallelFor(tiles, threadCount, [&](int tile)
+	{
+		if (progress && progress->Cancelled())
+		{
+			return;
+		}
+
+		TRACE_SCOPE("Light tile");
+		int end = std::min(vertCount, (tile + 1) * BAKE_TILE);
+		long long tileRays = 0;
+
+		for (int v = tile * BAKE_TILE; v < end; v++)
+		{
+			const float* n = bakeVerts[v].normal;
+
+			out[v] = LightVert(v, collide, size);
+			tileRays += hemisphereCount + (n[0] * sunDir[0] + n[1] * sunDir[1] + n[2] * sunDir[2] > 0.0f);
+		}
+
+		rays += tileRays;
+
+		if (progress)
+		{
+			progress->Advance();
+		}
+	});
+
+	raysCast = rays;
+	std::vector<Vert>().swap(bakeVerts);
+
+	bakeSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
@@ -0,0 +1,339 @@
+#include "BspPortals.h"
+
+#include <chrono>
+
+#include "MemTrack.h"
+#include "Trace.h"
+
+#define WORLD_MARGIN 1.0
+#define WORLD_SIZE 1.0e6
+
+BspPortals::BspPortals()
+{
+	emptyLeaves = solidLeaves = 0;
+	portalSeconds = cellSeconds = 0.0;
+	progress = NULL;
+}
+
+// A node or leaf still to visit, and the region it covers
+struct BspCellTask
+{
+	int child;
+	std::vector<BspCellFace> cell;
+};
+
+void BspPortals::BoxCell(const VisPlane* box, std::vector<BspCellFace>& cell) const
+{
+	cell.clear();
+
+	for (int i = 0; i < 6; i++)
+	{
+		BspCellFace face;
+		face.plane = box[i];
+		face.world = true;
+		face.winding = BaseWinding(FlipPlane(box[i]), WORLD_SIZE);
+
+		for (int j = 0; j < 6 && !face.winding.empty(); j++)
+		{
+			VisWinding front, back;
+
+			if (j != i)
+			{
+				SplitWinding(face.winding, box[j], front, back);
+				face.winding.swap(front);
+			}
+		}
+
+		if (!face.winding.empty())
+		{
+			cell.push_back(face);
+		}
+	}
+}
+
+void BspPortals::SplitCell(const std::vector<BspCellFace>& cell, const VisPlane& p, VisWinding& cut,
+	std::vector<BspCellFace>& front, std::vector<BspCellFace>& back) const
+{
+	front.clear();
+	back.clear();
+
+	// The plane cut down to the region, which becomes a face of both halves
+	cut = BaseWinding(p, WORLD_SIZE);
+
+	for (size_t i = 0; i < cell.size() && !cut.empty(); i++)
+	{
+		VisWinding f, b;
+		SplitWinding(cut, cell[i].plane, f, b);
+		cut.swap(f);
+	}
+
+	for (size_t i = 0; i < cell.size(); i++)
+	{
+		BspCellFace f, b;
+		SplitWinding(cell[i].winding, p, f.winding, b.winding);
+
+		if (!f.winding.empty())
+		{
+			f.plane = cell[i].plane;
+			f.world = cell[i].world;
+			front.push_back(f);
+		}
+
+		if (!b.winding.empty())
+		{
+			b.plane = cell[i].plane;
+			b.world = cell[i].world;
+			back.push_back(b);
+		}
+	}
+
+	if (!cut.empty())
+	{
+		BspCellFace f, b;
+
+		f.plane = p;
+		f.world = b.world = false;
+		f.winding.assign(cut.rbegin(), cut.rend());
+		front.push_back(f);
+
+		b.plane = FlipPlane(p);
+		b.winding = cut;
+		back.push_back(b);
+	}
+}
+
+void BspPortals::PushWinding(const BspTree& tree, const VisWinding& w, int child, std::vector<VisWinding>& windings, std::vector<int>& leaves) const
+{
+	std::vector<VisWinding> stack(1, w);
+	std::vector<int> children(1, child);
+
+	while (!stack.empty())
+	{
+		VisWinding piece;
+		piece.swap(stack.back());
+		child = children.back();
+		stack.pop_back();
+		children.pop_back();
+
+		if (child < 0)
+		{
+			windings.push_back(piece);
+			leaves.push_back(BSP_LEAF(child));
+			continue;
+		}
+
+		const BspNode& node = tree.nodes[child];
+		VisWinding front, back;
+
+		SplitWinding(piece, ToVisPlane(tree.planes[node.plane]), front, back);
+
+		// Back first so the front comes off next, same order as the tree
+		if (!back.empty())
+		{
+			stack.push_back(back);
+			children.push_back(node.back);
+		}
+
+		if (!front.empty())
+		{
+			stack.push_back(front);
+			children.push_back(node.front);
+		}
+	}
+}
+
+void BspPortals::MakeNodePortals(const BspTree& tree, const std::vector<BspCellFace>& world)
+{
+	std::vector<BspCellTask> stack(1);
+	std::vector<VisWinding> frontWindings, backWindings;
+	std::vector<int> frontLeaves, backLeaves;
+	VisWinding w;
+
+	stack[0].child = 0;
+	stack[0].cell = world;
+
+	while (!stack.empty())
+	{
+		if (progress)
+		{
+			if (progress->Cancelled())
+			{
+				return;
+			}
+
+			progress->Advance();
+		}
+
+		BspCellTask task = std::move(stack.back());
+		stack.pop_back();
+
+		const BspNode& node = tree.nodes[task.child];
+		VisPlane plane = ToVisPlane(tree.planes[node.plane]);
+		BspCellTask front, back;
+
+		// The node plane cut down to the convex cell the node covers
+		SplitCell(task.cell, plane, w, front.cell, back.cell);
+
+		if (!w.empty())
+		{
+			frontWindings.clear();
+			frontLeaves.clear();
+			PushWinding(tree, w, node.front, frontWindings, frontLeaves);
+
+			for (size_t i = 0; i < frontWindings.size(); i++)
+			{
+				if (tree.leaves[frontLeaves[i]].contents != BSP_EMPTY)
+				{
+					continue;
+				}
+
+				backWindings.clear();
+				backLeaves.clear();
+				PushWinding(tree, frontWindings[i], node.back, backWindings, backLeaves);
+
+				for (size_t j = 0; j < backWindings.size(); j++)
+				{
+					if (tree.leaves[backLeaves[j]].contents != BSP_EMPTY)
+					{
+						continue;
+					}
+
+					BspPortal portal;
+					portal.winding = backWindings[j];
+					portal.plane = plane;
+					portal.leaves[0] = frontLeaves[i];
+					portal.leaves[1] = backLeaves[j];
+					portals.push_back(portal);
+				}
+			}
+		}
+
+		if (node.back >= 0)
+		{
+			back.child = node.back;
+			stack.push_back(std::move(back));
+		}
+
+		if (node.front >= 0)
+		{
+			front.child = node.front;
+			stack.push_back(std::move(front));
+		}
+	}
+}
+
+void BspPortals::MakeCells(const BspTree& tree, const std::vector<BspCellFace>& world)
+{
+	std::vector<BspCellTask> stack(1);
+	VisWinding cut;
+
+	stack[0].child = 0;
+	stack[0].cell = world;
+
+	while (!stack.empty())
+	{
+		if (progress && progress->Cancelled())
+		{
+			return;
+		}
+
+		BspCellTask task = std::move(stack.back());
+		stack.pop_back();
+
+		if (task.child >= 0)
+		{
+			const BspNode& node = tree.nodes[task.child];
+			BspCellTask front, back;
+
+			SplitCell(task.cell, ToVisPlane(tree.planes[node.plane]), cut, front.cell, back.cell);
+
+			back.child = node.back;
+			stack.push_back(std::move(back));
+			front.child = node.front;
+			stack.push_back(std::move(front));
+			continue;
+		}
+
+		// The leaf's region has been cut down along with it, its faces are already the leaf's
+		BspCell& cell = cells[BSP_LEAF(task.child)];
+		cell.firstFace = (int)cellFaces.size();
+
+		for (size_t i = 0; i < task.cell.size(); i++)
+		{
+			cellFaces.push_back(task.cell[i].winding);
+			cell.outside |= task.cell[i].world;
+		}
+
+		cell.faceCount = (int)cellFaces.size() - cell.firstFace;
+
+		if (progress)
+		{
+			progress->Advance();
+		}
+	}
+}
+
+void BspPortals::Build(const BspTree& tree)
+{
+	TRACE_SCOPE("BspPortals::Build");
+	MemScope mem(MEM_VIS);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	std::vector<BspCellFace> world;
+
+	portals.clear();
+	cellFaces.clear();
+	cells.assign(tree.leaves.size(), BspCell());
+	emptyLeaves = solidLeaves = 0;
+
+	for (size_t i = 0; i < tree.leaves.size(); i++)
+	{
+		cells[i].firstFace = cells[i].faceCount = 0;
+		cells[i].outside = false;
+		emptyLeaves += tree.leaves[i].contents == BSP_EMPTY;
+		solidLeaves += tree.leaves[i].contents == BSP_SOLID;
+	}
+
+	if (tree.nodes.empty())
+	{
+		portalSeconds = cellSeconds = 0.0;
+		return;
+	}
+
+	// Box the whole thing in so the outside leaves end up with sensibly sized portals and cells
+	const BspBounds& b = tree.nodes[0].bounds;
+	VisPlane box[6] =
+	{
+		{ 1.0, 0.0, 0.0, b.min.x / 65536.0 - WORLD_MARGIN },
+		{ 0.0, 1.0, 0.0, b.min.y / 65536.0 - WORLD_MARGIN },
+		{ 0.0, 0.0, 1.0, b.min.z / 65536.0 - WORLD_MARGIN },
+		{ -1.0, 0.0, 0.0, -b.max.x / 65536.0 - WORLD_MARGIN },
+		{ 0.0, -1.0, 0.0, -b.max.y / 65536.0 - WORLD_MARGIN },
+		{ 0.0, 0.0, -1.0, -b.max.z / 65536.0 - WORLD_MARGIN },
+	};
+
+	if (progress)
+	{
+		progress->Begin("Finding portals", (long long)tree.nodes.size());
+	}
+
+	{
+		TRACE_SCOPE("Finding portals");
+		BoxCell(box, world);
+		MakeNodePortals(tree, world);
+	}
+
+	std::chrono::high_resolution_clock::time_point portalEnd = std::chrono::high_resolution_clock::now();
+	portalSeconds = std::chrono::duration<double>(portalEnd - start).count();
+
+	if (progress)
+	{
+		progress->Begin("Extracting cells", (long long)tree.leaves.size());
+	}
+
+	{
+		TRACE_SCOPE("Extracting cells");
+		MakeCells(tree, world);
+	}
+
+	cellSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - portalEnd).count();
+}
@@ -0,0 +1,867 @@
+#include "BspStream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#include "MemTrack.h"
+#include "ObjLineReader.h"
+#include "Trace.h"
+
+// Triangles read or written per call
+#define STREAM_BATCH 4096
+
+#define STREAM_FILE_BUFFER (1 << 20)
+
+// The most of a bucket either side of a split can hold, in percent, before streaming the bucket
+// through it isn't reckoned worth it
+#define STREAM_MAX_SIDE 90
+
+// How much of the .obj is read at once, and how many parsed batches can wait for the builder
+#define OBJ_READ_BUFFER (1 << 20)
+#define OBJ_QUEUE_BATCHES 8
+
+struct BspVecHash
+{
+	size_t operator()(const BspVec& v) const
+	{
+		return (size_t)(((uint64_t)(uint32_t)v.x * 0x9E3779B1u) ^ ((uint64_t)(uint32_t)v.y * 0x85EBCA77u) ^ ((uint64_t)(uint32_t)v.z * 0xC2B2AE3Du));
+	}
+};
+
+struct BspVecEqual
+{
+	bool operator()(const BspVec& a, const BspVec& b) const
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+};
+
+typedef std::unordered_map<BspVec, unsigned int, BspVecHash, BspVecEqual> BspVecMap;
+
+// Welds as it goes, so the subtree's triangles share verts like they would have in the mesh
+static unsigned int WeldVert(BspTree& tree, BspVecMap& map, const BspVec& v)
+{
+	std::pair<BspVecMap::iterator, bool> it = map.insert(std::make_pair(v, (unsigned int)tree.verts.size()));
+
+	if (it.second)
+	{
+		tree.verts.push_back(v);
+	}
+
+	return it.first->second;
+}
+
+BspObjSource::BspObjSource(Obj& o, bool freeWhenDone) : o(o), freeWhenDone(freeWhenDone), next(0)
+{
+}
+
+BspObjSource::~BspObjSource()
+{
+	Free();
+}
+
+void BspObjSource::Free()
+{
+	if (!freeWhenDone || (!o.verts && !o.indices))
+	{
+		return;
+	}
+
+	MemTrack::Sub(MEM_LOADER, ObjBytes(o));
+	free(o.verts);
+	free(o.indices);
+	memset(&o, 0, sizeof(o));
+}
+
+int BspObjSource::Read(BspTri* out, int max)
+{
+	int count = 0;
+
+	while (count < max && next + 2 < o.indexCount)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			long i = o.indices[next + k];
+
+			if (i < 0 || i >= o.vertCount)
+			{
+				return -1;
+			}
+
+			out[count].v[k].x = (fix16)o.verts[i].x;
+			out[count].v[k].y = (fix16)o.verts[i].y;
+			out[count].v[k].z = (fix16)o.verts[i].z;
+		}
+
+		next += 3;
+		count++;
+	}
+
+	if (!count)
+	{
+		Free();
+	}
+
+	return count;
+}
+
+BspObjStream::BspObjStream() : bytesRead(0), vertCount(0), triCount(0)
+{
+	waitSeconds = 0.0;
+	f = NULL;
+	currentNext = 0;
+	done = failed = stopping = false;
+}
+
+BspObjStream::~BspObjStream()
+{
+	Close();
+}
+
+bool BspObjStream::Open(const char* path)
+{
+	Close();
+
+	if (!(f = fopen(path, "rb")))
+	{
+		return false;
+	}
+
+	bytesRead = vertCount = triCount = 0;
+	waitSeconds = 0.0;
+	full.clear();
+	current.clear();
+	currentNext = 0;
+	verts.clear();
+	done = failed = stopping = false;
+
+	reader = std::thread([this]()
+	{
+		Trace::SetThreadName("Reader");
+		Run();
+	});
+
+	return true;
+}
+
+void BspObjStream::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	space.notify_all();
+
+	if (reader.joinable())
+	{
+		reader.join();
+	}
+
+	if (f)
+	{
+		fclose(f);
+		f = NULL;
+	}
+
+	full.clear();
+	current.clear();
+	currentNext = 0;
+	std::vector<BspVec>().swap(verts);
+}
+
+bool BspObjStream::Push(std::vector<BspTri>& batch)
+{
+	std::vector<BspTri> next;
+	std::unique_lock<std::mutex> lock(mutex);
+
+	space.wait(lock, [this]() { return full.size() < OBJ_QUEUE_BATCHES || stopping; });
+
+	if (stopping)
+	{
+		return false;
+	}
+
+	full.push_back(std::move(batch));
+
+	if (!spare.empty())
+	{
+		next.swap(spare.back());
+		spare.pop_back();
+	}
+
+	lock.unlock();
+	ready.notify_one();
+
+	batch.swap(next);
+	batch.clear();
+	return true;
+}
+
+bool BspObjStream::ParseLine(char* line, std::vector<BspTri>& batch)
+{
+	while (*line == ' ' || *line == '\t')
+	{
+		line++;
+	}
+
+	if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+	{
+		char* p = line + 2;
+		BspVec v;
+
+		// Converted the same way loadObj does
+		v.x = (fix16)(strtof(p, &p) * 65536.0f);
+		v.y = (fix16)(strtof(p, &p) * 65536.0f);
+		v.z = (fix16)(strtof(p, &p) * 65536.0f);
+
+		verts.push_back(v);
+		vertCount.store((long long)verts.size(), std::memory_order_relaxed);
+	}
+	else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+	{
+		long long vertTotal = (long long)verts.size();
+		long long first = 0, prev = 0;
+		int count = 0;
+		char* p = line + 2;
+		long long index;
+
+		// Only the position index matters
+		while (ObjLineReader::FaceIndex(p, index))
+		{
+			index = index < 0 ? vertTotal + index : index - 1;
+
+			if (index < 0 || index >= vertTotal)
+			{
+				return false;
+			}
+
+			if (count == 0)
+			{
+				first = index;
+			}
+			else if (count >= 2)
+			{
+				BspTri t = { { verts[(size_t)first], verts[(size_t)prev], verts[(size_t)index] } };
+				batch.push_back(t);
+				triCount.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			prev = index;
+			count++;
+		}
+	}
+
+	return true;
+}
+
+void BspObjStream::Run()
+{
+	TRACE_SCOPE("Parsing OBJ");
+	MemScope mem(MEM_LOADER);
+	ObjLineReader reader(f, OBJ_READ_BUFFER);
+	std::vector<BspTri> batch;
+	char* line;
+	bool ok = true;
+
+	while (ok && (line = reader.Next()) != NULL)
+	{
+		ok = ParseLine(line, batch);
+		bytesRead.store(reader.BytesRead(), std::memory_order_relaxed);
+
+		if (ok && batch.size() >= STREAM_BATCH)
+		{
+			ok = Push(batch);
+		}
+	}
+
+	ok = ok && !ferror(f);
+
+	if (ok && !batch.empty())
+	{
+		ok = Push(batch);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done = true;
+		failed = !ok;
+	}
+
+	ready.notify_all();
+}
+
+int BspObjStream::Read(BspTri* out, int max)
+{
+	int count = 0;
+
+	while (count < max)
+	{
+		if (currentNext == current.size())
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (!current.empty())
+			{
+				spare.push_back(std::move(current));
+				current.clear();
+			}
+
+			currentNext = 0;
+
+			if (full.empty() && !done && !stopping)
+			{
+				TRACE_SCOPE("Waiting for parser");
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+				ready.wait(lock, [this]() { return !full.empty() || done || stopping; });
+				waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+
+			if (full.empty())
+			{
+				if (count)
+				{
+					break;
+				}
+
+				// Done without a hitch, otherwise the file was bad or we were closed early
+				return done && !failed ? 0 : -1;
+			}
+
+			current.swap(full.front());
+			full.pop_front();
+			lock.unlock();
+			space.notify_one();
+		}
+
+		size_t n = std::min((size_t)(max - count), current.size() - currentNext);
+
+		std::copy(current.begin() + currentNext, current.begin() + currentNext + n, out + count);
+		currentNext += n;
+		count += (int)n;
+	}
+
+	return count;
+}
+
+BspStreamBuilder::BspStreamBuilder()
+{
+	memoryBudget = 1024LL * 1024 * 1024;
+	tmpDir = ".";
+	progress = NULL;
+
+	buckets = inCoreBuckets = forcedBuckets = maxDepth = 0;
+	bytesSpilled = trisRead = 0;
+	readSeconds = seconds = 0.0;
+
+	tree = NULL;
+	inCoreTris = 0;
+	nextFile = 0;
+	rng = 0;
+	failed = false;
+}
+
+bool BspStreamBuilder::MakePlane(const BspTri& t, BspPlane& p)
+{
+	static const unsigned int tri[3] = { 0, 1, 2 };
+
+	scratch.verts.assign(t.v, t.v + 3);
+	return scratch.MakePlane(tri, p);
+}
+
+FILE* BspStreamBuilder::OpenBucket(Bucket& bucket)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%s-%i.tmp", prefix.c_str(), nextFile++);
+
+	bucket.path = tmpDir + "/" + name;
+	bucket.count = 0;
+	bucket.sample.clear();
+
+	FILE* f = fopen(bucket.path.c_str(), "wb");
+
+	if (f)
+	{
+		setvbuf(f, NULL, _IOFBF, STREAM_FILE_BUFFER);
+		buckets++;
+	}
+
+	return f;
+}
+
+void BspStreamBuilder::Emit(FILE* f, Bucket& bucket, const BspTri& t)
+{
+	fwrite(&t, sizeof(t), 1, f);
+	bytesSpilled += sizeof(t);
+
+	// Reservoir sampling, every triangle so far equally likely to be in the sample
+	if (bucket.sample.size() < BSP_STREAM_SAMPLE)
+	{
+		bucket.sample.push_back(t);
+	}
+	else
+	{
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+
+		uint64_t slot = rng % (uint64_t)(bucket.count + 1);
+
+		if (slot < BSP_STREAM_SAMPLE)
+		{
+			bucket.sample[(size_t)slot] = t;
+		}
+	}
+
+	bucket.count++;
+}
+
+bool BspStreamBuilder::ReadBucket(const Bucket& bucket, std::vector<BspTri>& tris)
+{
+	FILE* f = fopen(bucket.path.c_str(), "rb");
+
+	if (!f)
+	{
+		return false;
+	}
+
+	tris.resize((size_t)bucket.count);
+
+	bool ok = fread(tris.data(), sizeof(BspTri), tris.size(), f) == tris.size();
+	fclose(f);
+	remove(bucket.path.c_str());
+	return ok;
+}
+
+int BspStreamBuilder::BuildInCore(std::vector<BspTri>& tris, int leafContents, long long work)
+{
+	TRACE_SCOPE("Building bucket");
+	std::vector<unsigned int> indices;
+	BspVecMap map;
+
+	indices.reserve(tris.size() * 3);
+	map.reserve(tris.size());
+
+	for (size_t i = 0; i < tris.size(); i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			indices.push_back(WeldVert(*tree, map, tris[i].v[k]));
+		}
+	}
+
+	std::vector<BspTri>().swap(tris);
+	BspVecMap().swap(map);
+
+	return tree->BuildNode(indices, leafContents, work);
+}
+
+
+bool BspStreamBuilder::BeginSplit(Split& s, const std::vector<BspTri>& sample)
+{
+	// The splitter is chosen from the sample the same way BuildNode chooses from everything
+	std::vector<unsigned int> sampleTris(sample.size() * 3);
+
+	scratch.verts.clear();
+
+	for (size_t i = 0; i < sample.size(); i++)
+	{
+		scratch.verts.insert(scratch.verts.end(), sample[i].v, sample[i].v + 3);
+		sampleTris[i * 3 + 0] = (unsigned int)i * 3 + 0;
+		sampleTris[i * 3 + 1] = (unsigned int)i * 3 + 1;
+		sampleTris[i * 3 + 2] = (unsigned int)i * 3 + 2;
+	}
+
+	int splitter = scratch.ChooseSplitter(sampleTris);
+	BspPlane axis;
+
+	scratch.MakePlane(&sampleTris[splitter * 3], s.p);
+	s.splitter = sample[splitter];
+	s.axis = false;
+
+	// Anything convex has every face plane with all the rest behind it, so the whole bucket would
+	// go through again to come out one triangle smaller. A cut through the middle does better.
+	if (!Balanced(sampleTris, s.p) && scratch.AxisPlane(sampleTris, axis) && Balanced(sampleTris, axis))
+	{
+		s.p = axis;
+		s.axis = true;
+	}
+
+	s.frontFile = OpenBucket(s.front);
+	s.backFile = OpenBucket(s.back);
+	return s.frontFile && s.backFile;
+}
+
+bool BspStreamBuilder::Balanced(const std::vector<unsigned int>& sampleTris, const BspPlane& p) const
+{
+	size_t count = sampleTris.size() / 3, front = 0, back = 0;
+
+	for (size_t t = 0; t < count; t++)
+	{
+		int pos = 0, neg = 0;
+
+		for (int k = 0; k < 3; k++)
+		{
+			fix16 d = scratch.Distance(p, scratch.verts[sampleTris[t * 3 + k]]);
+			pos += d > BSP_EPSILON;
+			neg += d < -BSP_EPSILON;
+		}
+
+		front += pos != 0;
+		back += neg != 0;
+	}
+
+	return std::max(front, back) * 100 <= count * STREAM_MAX_SIDE;
+}
+
+void BspStreamBuilder::Partition(Split& s, const BspTri& t)
+{
+	int pos = 0, neg = 0;
+
+	for (int k = 0; k < 3; k++)
+	{
+		fix16 d = tree->Distance(s.p, t.v[k]);
+		pos += d > BSP_EPSILON;
+		neg += d < -BSP_EPSILON;
+	}
+
+	// The splitter always lands on its own plane, even if rounding says otherwise
+	if ((!pos && !neg) || (!s.axis && !memcmp(&t, &s.splitter, sizeof(t))))
+	{
+		BspPlane tp;
+		MakePlane(t, tp);
+
+		if ((long long)tp.nx * s.p.nx + (long long)tp.ny * s.p.ny + (long long)tp.nz * s.p.nz >= 0)
+		{
+			s.onFront.push_back(t);
+		}
+		else
+		{
+			s.onBack.push_back(t);
+		}
+	}
+	else if (!neg)
+	{
+		Emit(s.frontFile, s.front, t);
+	}
+	else if (!pos)
+	{
+		Emit(s.backFile, s.back, t);
+	}
+	else
+	{
+		static const unsigned int tri[3] = { 0, 1, 2 };
+
+		scratch.verts.assign(t.v, t.v + 3);
+		s.fragFront.clear();
+		s.fragBack.clear();
+		scratch.SplitTri(tri, s.p, s.fragFront, s.fragBack);
+
+		for (size_t i = 0; i < s.fragFront.size(); i += 3)
+		{
+			BspTri frag = { { scratch.verts[s.fragFront[i]], scratch.verts[s.fragFront[i + 1]], scratch.verts[s.fragFront[i + 2]] } };
+			Emit(s.frontFile, s.front, frag);
+		}
+
+		for (size_t i = 0; i < s.fragBack.size(); i += 3)
+		{
+			BspTri frag = { { scratch.verts[s.fragBack[i]], scratch.verts[s.fragBack[i + 1]], scratch.verts[s.fragBack[i + 2]] } };
+			Emit(s.backFile, s.back, frag);
+		}
+	}
+}
+
+bool BspStreamBuilder::EndSplit(Split& s, bool ok)
+{
+	ok = ok && s.frontFile && s.backFile && !ferror(s.frontFile) && !ferror(s.backFile);
+	ok = (!s.frontFile || fclose(s.frontFile) == 0) && ok;
+	ok = (!s.backFile || fclose(s.backFile) == 0) && ok;
+	ok = ok && (s.axis || !s.onFront.empty() || !s.onBack.empty());
+
+	s.frontFile = s.backFile = NULL;
+
+	tree->splitCount += scratch.splitCount;
+	scratch.splitCount = 0;
+
+	if (!ok)
+	{
+		remove(s.front.path.c_str());
+		remove(s.back.path.c_str());
+	}
+
+	return ok;
+}
+
+int BspStreamBuilder::BuildSplit(Split& s, long long work, int depth, long long count)
+{
+	// The sample put something either side of an axis plane, but the rest of the bucket needn't
+	// have. With nothing on the plane either there's no telling what the empty side would be, so
+	// there's no node, just the other side, which the size check will then build in memory.
+	if (s.axis && s.onFront.empty() && s.onBack.empty() && (!s.front.count || !s.back.count))
+	{
+		Bucket& empty = s.front.count ? s.back : s.front;
+		Bucket& rest = s.front.count ? s.front : s.back;
+
+		remove(empty.path.c_str());
+		return BuildBucket(rest, s.front.count ? BSP_EMPTY : BSP_SOLID, work, depth + 1, count);
+	}
+
+	std::vector<unsigned int> onFront, onBack;
+
+	{
+		BspVecMap map;
+
+		for (size_t i = 0; i < s.onFront.size(); i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				onFront.push_back(WeldVert(*tree, map, s.onFront[i].v[k]));
+			}
+		}
+
+		for (size_t i = 0; i < s.onBack.size(); i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				onBack.push_back(WeldVert(*tree, map, s.onBack[i].v[k]));
+			}
+		}
+	}
+
+	int nodeIndex = tree->BeginNode(s.p, onFront, onBack);
+	long long frontWork, backWork;
+
+	tree->ShareWork(work, s.onFront.size() + s.onBack.size(), (size_t)s.front.count, (size_t)s.back.count, frontWork, backWork);
+
+	std::vector<unsigned int>().swap(onFront);
+	std::vector<unsigned int>().swap(onBack);
+	std::vector<BspTri>().swap(s.onFront);
+	std::vector<BspTri>().swap(s.onBack);
+
+	int frontChild = BuildBucket(s.front, BSP_EMPTY, frontWork, depth + 1, count);
+	int backChild = BuildBucket(s.back, BSP_SOLID, backWork, depth + 1, count);
+
+	tree->EndNode(nodeIndex, frontChild, backChild);
+	return nodeIndex;
+}
+
+int BspStreamBuilder::BuildBucket(Bucket& bucket, int leafContents, long long work, int depth, long long parentCount)
+{
+	if (failed || (progress && progress->Cancelled()) || !bucket.count)
+	{
+		remove(bucket.path.c_str());
+		return tree->AddLeaf(leafContents, work);
+	}
+
+	// Splits can leave a side hardly any smaller than what came in, and going round again for
+	// the sake of a few triangles a time is far worse than building it as is
+	if (bucket.count <= inCoreTris || bucket.count * 100 > parentCount * STREAM_MAX_SIDE)
+	{
+		std::vector<BspTri> tris;
+
+		if (bucket.count <= inCoreTris)
+		{
+			inCoreBuckets++;
+		}
+		else
+		{
+			forcedBuckets++;
+		}
+
+		if (!ReadBucket(bucket, tris))
+		{
+			failed = true;
+			return tree->AddLeaf(leafContents, work);
+		}
+
+		return BuildInCore(tris, leafContents, work);
+	}
+
+	TRACE_SCOPE("Splitting bucket");
+	maxDepth = std::max(maxDepth, depth + 1);
+
+	Split s;
+	bool ok = BeginSplit(s, bucket.sample);
+	FILE* in = ok ? fopen(bucket.path.c_str(), "rb") : NULL;
+
+	std::vector<BspTri>().swap(bucket.sample);
+
+	if (in)
+	{
+		std::vector<BspTri> batch(STREAM_BATCH);
+		size_t n;
+
+		setvbuf(in, NULL, _IOFBF, STREAM_FILE_BUFFER);
+
+		while ((n = fread(batch.data(), sizeof(BspTri), STREAM_BATCH, in)) > 0)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				Partition(s, batch[i]);
+			}
+		}
+
+		ok = !ferror(in);
+		fclose(in);
+	}
+
+	remove(bucket.path.c_str());
+
+	if (!EndSplit(s, in && ok))
+	{
+		failed = true;
+		return tree->AddLeaf(leafContents, work);
+	}
+
+	return BuildSplit(s, work, depth, bucket.count);
+}
+
+bool BspStreamBuilder::ReadSource(BspTriSource& source, std::vector<BspTri>& tris, Split& root, long long& count)
+{
+	TRACE_SCOPE("Reading triangles");
+	std::vector<BspTri> batch(STREAM_BATCH);
+	bool splitting = false;
+	BspPlane p;
+	int n;
+
+	while ((n = source.Read(batch.data(), STREAM_BATCH)) > 0)
+	{
+		trisRead += n;
+
+		for (int i = 0; i < n; i++)
+		{
+			if (!MakePlane(batch[i], p))
+			{
+				continue;
+			}
+
+			count++;
+
+			if (splitting)
+			{
+				Partition(root, batch[i]);
+			}
+			else
+			{
+				tris.push_back(batch[i]);
+			}
+		}
+
+		// Too many to build in memory, so the root is split by a plane from what's come in so far,
+		// with the rest going straight through it while the source is still being read
+		if (!splitting && (long long)tris.size() > inCoreTris)
+		{
+			TRACE_SCOPE("Splitting root");
+			std::vector<BspTri> sample;
+			size_t step = tris.size() / BSP_STREAM_SAMPLE + 1;
+
+			for (size_t i = 0; i < tris.size(); i += step)
+			{
+				sample.push_back(tris[i]);
+			}
+
+			splitting = true;
+			maxDepth = 1;
+
+			if (!BeginSplit(root, sample))
+			{
+				return false;
+			}
+
+			for (size_t i = 0; i < tris.size(); i++)
+			{
+				Partition(root, tris[i]);
+			}
+
+			std::vector<BspTri>().swap(tris);
+		}
+	}
+
+	return n == 0;
+}
+
+bool BspStreamBuilder::Build(BspTree& tree, BspTriSource& source)
+{
+	TRACE_SCOPE("BspStreamBuilder::Build");
+	MemScope mem(MEM_BSP);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	std::vector<BspTri> tris;
+	long long count = 0;
+	Split root;
+
+	this->tree = &tree;
+	tree.Clear();
+
+	scratch.splitterCandidates = tree.splitterCandidates;
+	scratch.splitterSamples = tree.splitterSamples;
+	scratch.splitPenalty = tree.splitPenalty;
+
+	buckets = inCoreBuckets = forcedBuckets = maxDepth = 0;
+	bytesSpilled = trisRead = 0;
+	inCoreTris = std::max(memoryBudget / BSP_STREAM_TRI_BYTES, (long long)BSP_STREAM_SAMPLE);
+	nextFile = 0;
+	rng = 0x9E3779B97F4A7C15ULL;
+	failed = false;
+	root.frontFile = root.backFile = NULL;
+
+	// Enough to keep two builds sharing a temp directory out of each other's way
+	char name[64];
+	snprintf(name, sizeof(name), "polytree-%llx", (unsigned long long)start.time_since_epoch().count());
+	prefix = name;
+
+	if (progress)
+	{
+		progress->Begin("Reading triangles", 0);
+	}
+
+	bool ok = ReadSource(source, tris, root, count);
+	bool split = !root.front.path.empty();
+
+	if (split)
+	{
+		ok = EndSplit(root, ok);
+	}
+
+	readSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (!ok)
+	{
+		tree.Clear();
+		scratch.verts.clear();
+		return false;
+	}
+
+	BuildProgress* treeProgress = tree.progress;
+	tree.progress = progress;
+
+	if (progress)
+	{
+		progress->Begin("Building BSP", BSP_BUILD_WORK);
+	}
+
+	if (split)
+	{
+		BuildSplit(root, BSP_BUILD_WORK, 0, count);
+	}
+	else
+	{
+		inCoreBuckets++;
+		BuildInCore(tris, BSP_EMPTY, BSP_BUILD_WORK);
+	}
+
+	tree.progress = treeProgress;
+	scratch.verts.clear();
+
+	if (failed)
+	{
+		tree.Clear();
+	}
+
+	seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	tree.buildSeconds = seconds;
+	return !failed;
+}
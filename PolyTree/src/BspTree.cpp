@@ -0,0 +1,909 @@
+#include "BspTree.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+
+#include "MemTrack.h"
+#include "Trace.h"
+
+#define MAX_SPLITTER_CANDIDATES 16
+#define MAX_SPLITTER_SAMPLES 1024
+#define SPLIT_PENALTY 8
+
+// Nodes with more triangles than this are cut through the middle when their best face plane
+// leaves everything to one side
+#define CHAIN_TRIS 256
+
+// Nodes smaller than this aren't worth a trace event each
+#define TRACE_NODE_TRIS 4096
+
+#define EXPORT_MAGIC 0x50544253	// "PTBS"
+#define EXPORT_VERSION 2
+
+static double TriArea2(const BspVec& a, const BspVec& b, const BspVec& c, double* n)
+{
+	double ux = (double)b.x - a.x, uy = (double)b.y - a.y, uz = (double)b.z - a.z;
+	double vx = (double)c.x - a.x, vy = (double)c.y - a.y, vz = (double)c.z - a.z;
+
+	n[0] = uy * vz - uz * vy;
+	n[1] = uz * vx - ux * vz;
+	n[2] = ux * vy - uy * vx;
+
+	return sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+}
+
+static fix16 ToFix(double v)
+{
+	return (fix16)floor(v + 0.5);
+}
+
+static void AddRange(std::vector<BspRange>& out, int first, int count)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	// Neighbouring ranges are common in pre-order, so fold them into a single draw
+	if (!out.empty() && out.back().firstTri + out.back().triCount == first)
+	{
+		out.back().triCount += count;
+		return;
+	}
+
+	BspRange r = { first, count };
+	out.push_back(r);
+}
+
+BspFrustum::BspFrustum(const float* m)
+{
+	// Gribb & Hartmann: each plane is the last row of the matrix plus or minus one of the others
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			planes[i * 2 + 0][j] = m[j * 4 + 3] + m[j * 4 + i];
+			planes[i * 2 + 1][j] = m[j * 4 + 3] - m[j * 4 + i];
+		}
+	}
+}
+
+int BspFrustum::Test(const BspBounds& b) const
+{
+	float mn[3] = { b.min.x / 65536.0f, b.min.y / 65536.0f, b.min.z / 65536.0f };
+	float mx[3] = { b.max.x / 65536.0f, b.max.y / 65536.0f, b.max.z / 65536.0f };
+	int result = BSP_INSIDE;
+
+	for (int i = 0; i < 6; i++)
+	{
+		const float* p = planes[i];
+		float nearDist = p[3], farDist = p[3];
+
+		for (int j = 0; j < 3; j++)
+		{
+			if (p[j] >= 0.0f)
+			{
+				farDist += p[j] * mx[j];
+				nearDist += p[j] * mn[j];
+			}
+			else
+			{
+				farDist += p[j] * mn[j];
+				nearDist += p[j] * mx[j];
+			}
+		}
+
+		if (farDist < 0.0f)
+		{
+			return BSP_OUTSIDE;
+		}
+
+		if (nearDist < 0.0f)
+		{
+			result = BSP_INTERSECT;
+		}
+	}
+
+	return result;
+}
+
+BspTree::BspTree()
+{
+	splitCount = 0;
+	buildSeconds = 0.0;
+	progress = NULL;
+
+	splitterCandidates = MAX_SPLITTER_CANDIDATES;
+	splitterSamples = MAX_SPLITTER_SAMPLES;
+	splitPenalty = SPLIT_PENALTY;
+}
+
+void BspTree::Build(const Obj& o)
+{
+	TRACE_SCOPE("BspTree::Build");
+	MemScope mem(MEM_BSP);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	std::vector<unsigned int> tris;
+	BspPlane p;
+
+	Clear();
+
+	{
+		TRACE_SCOPE("Copying verts");
+		verts.resize(o.vertCount);
+
+		for (int i = 0; i < o.vertCount; i++)
+		{
+			verts[i].x = (fix16)o.verts[i].x;
+			verts[i].y = (fix16)o.verts[i].y;
+			verts[i].z = (fix16)o.verts[i].z;
+		}
+	}
+
+	{
+		TRACE_SCOPE("Dropping degenerates");
+		tris.reserve(o.indexCount);
+
+		for (int i = 0; i + 2 < o.indexCount; i += 3)
+		{
+			unsigned int tri[3] = { (unsigned int)o.indices[i], (unsigned int)o.indices[i + 1], (unsigned int)o.indices[i + 2] };
+
+			// Degenerate triangles have no plane to split by, and nothing to draw either
+			if (MakePlane(tri, p))
+			{
+				tris.insert(tris.end(), tri, tri + 3);
+			}
+		}
+	}
+
+	if (progress)
+	{
+		progress->Begin("Building BSP", BSP_BUILD_WORK);
+	}
+
+	{
+		TRACE_SCOPE("Building nodes");
+		BuildNode(tris, BSP_EMPTY, BSP_BUILD_WORK);
+	}
+
+	buildSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void BspTree::Clear()
+{
+	verts.clear();
+	indices.clear();
+	planes.clear();
+	nodes.clear();
+	leaves.clear();
+	visData.clear();
+	vertLight.clear();
+	splitCount = 0;
+}
+
+void BspTree::ToFloat(const BspVec* in, size_t count, float* out)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i * 3 + 0] = in[i].x / 65536.0f;
+		out[i * 3 + 1] = in[i].y / 65536.0f;
+		out[i * 3 + 2] = in[i].z / 65536.0f;
+	}
+}
+
+fix16 BspTree::Distance(const BspPlane& p, const BspVec& v) const
+{
+	int64_t dot = (int64_t)p.nx * v.x + (int64_t)p.ny * v.y + (int64_t)p.nz * v.z;
+
+	return (fix16)((dot >> 16) - p.d);
+}
+
+bool BspTree::MakePlane(const unsigned int* tri, BspPlane& p) const
+{
+	const BspVec& a = verts[tri[0]];
+	double n[3];
+	double len = TriArea2(a, verts[tri[1]], verts[tri[2]], n);
+
+	if (len < 1.0)
+	{
+		return false;
+	}
+
+	p.nx = ToFix(n[0] / len * FIX_ONE);
+	p.ny = ToFix(n[1] / len * FIX_ONE);
+	p.nz = ToFix(n[2] / len * FIX_ONE);
+	p.d = 0;
+	p.d = Distance(p, a);
+
+	return true;
+}
+
+unsigned int BspTree::AddVert(const BspVec& v)
+{
+	verts.push_back(v);
+	return (unsigned int)verts.size() - 1;
+}
+
+void BspTree::GrowBounds(BspBounds& b, const BspVec& v) const
+{
+	if (v.x < b.min.x) b.min.x = v.x;
+	if (v.y < b.min.y) b.min.y = v.y;
+	if (v.z < b.min.z) b.min.z = v.z;
+	if (v.x > b.max.x) b.max.x = v.x;
+	if (v.y > b.max.y) b.max.y = v.y;
+	if (v.z > b.max.z) b.max.z = v.z;
+}
+
+int BspTree::ChooseSplitter(const std::vector<unsigned int>& tris)
+{
+	int triCount = (int)tris.size() / 3;
+	int candidateStep = triCount / splitterCandidates + 1;
+	int sampleStep = triCount / splitterSamples + 1;
+	int best = 0, bestScore = -1;
+	BspPlane p;
+
+	for (int c = 0; c < triCount; c += candidateStep)
+	{
+		int front = 0, back = 0, split = 0;
+
+		MakePlane(&tris[c * 3], p);
+
+		for (int t = 0; t < triCount; t += sampleStep)
+		{
+			int pos = 0, neg = 0;
+
+			for (int k = 0; k < 3; k++)
+			{
+				fix16 d = Distance(p, verts[tris[t * 3 + k]]);
+				pos += d > BSP_EPSILON;
+				neg += d < -BSP_EPSILON;
+			}
+
+			if (pos && neg)
+			{
+				split++;
+			}
+			else if (pos)
+			{
+				front++;
+			}
+			else if (neg)
+			{
+				back++;
+			}
+		}
+
+		int score = split * splitPenalty + abs(front - back);
+
+		if (bestScore < 0 || score < bestScore)
+		{
+			best = c;
+			bestScore = score;
+		}
+	}
+
+	return best;
+}
+
+void BspTree::SplitTri(const unsigned int* tri, const BspPlane& p, std::vector<unsigned int>& front, std::vector<unsigned int>& back)
+{
+	unsigned int f[4], b[4];
+	int fc = 0, bc = 0;
+	fix16 d[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		d[i] = Distance(p, verts[tri[i]]);
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		int j = (i + 1) % 3;
+
+		if (d[i] >= -BSP_EPSILON)
+		{
+			f[fc++] = tri[i];
+		}
+
+		if (d[i] <= BSP_EPSILON)
+		{
+			b[bc++] = tri[i];
+		}
+
+		if ((d[i] > BSP_EPSILON && d[j] < -BSP_EPSILON) || (d[i] < -BSP_EPSILON && d[j] > BSP_EPSILON))
+		{
+			const BspVec& va = verts[tri[i]];
+			const BspVec& vb = verts[tri[j]];
+			double t = (double)d[i] / ((double)d[i] - d[j]);
+			BspVec v;
+
+			v.x = ToFix(va.x + (vb.x - (double)va.x) * t);
+			v.y = ToFix(va.y + (vb.y - (double)va.y) * t);
+			v.z = ToFix(va.z + (vb.z - (double)va.z) * t);
+
+			unsigned int vi = AddVert(v);
+			f[fc++] = vi;
+			b[bc++] = vi;
+		}
+	}
+
+	splitCount++;
+
+	// Fan the clipped polygons back into triangles, dropping any slivers that collapsed
+	BspPlane unused;
+
+	for (int i = 1; i + 1 < fc; i++)
+	{
+		unsigned int t[3] = { f[0], f[i], f[i + 1] };
+
+		if (MakePlane(t, unused))
+		{
+			front.insert(front.end(), t, t + 3);
+		}
+	}
+
+	for (int i = 1; i + 1 < bc; i++)
+	{
+		unsigned int t[3] = { b[0], b[i], b[i + 1] };
+
+		if (MakePlane(t, unused))
+		{
+			back.insert(back.end(), t, t + 3);
+		}
+	}
+}
+
+bool BspTree::AxisPlane(const std::vector<unsigned int>& tris, BspPlane& p) const
+{
+	int triCount = (int)tris.size() / 3;
+	std::vector<BspVec> centres(triCount);
+	BspBounds b;
+
+	for (int t = 0; t < triCount; t++)
+	{
+		const BspVec& v0 = verts[tris[t * 3 + 0]];
+		const BspVec& v1 = verts[tris[t * 3 + 1]];
+		const BspVec& v2 = verts[tris[t * 3 + 2]];
+
+		centres[t].x = (fix16)(((int64_t)v0.x + v1.x + v2.x) / 3);
+		centres[t].y = (fix16)(((int64_t)v0.y + v1.y + v2.y) / 3);
+		centres[t].z = (fix16)(((int64_t)v0.z + v1.z + v2.z) / 3);
+
+		if (t == 0)
+		{
+			b.min = b.max = centres[t];
+		}
+		else
+		{
+			GrowBounds(b, centres[t]);
+		}
+	}
+
+	int64_t size[3] = { (int64_t)b.max.x - b.min.x, (int64_t)b.max.y - b.min.y, (int64_t)b.max.z - b.min.z };
+	int axis = size[1] > size[0] ? 1 : 0;
+
+	if (size[2] > size[axis])
+	{
+		axis = 2;
+	}
+
+	if (size[axis] <= BSP_EPSILON * 2)
+	{
+		return false;
+	}
+
+	// Through the median centre along the longest axis
+	std::vector<fix16> along(triCount);
+
+	for (int t = 0; t < triCount; t++)
+	{
+		along[t] = axis == 0 ? centres[t].x : axis == 1 ? centres[t].y : centres[t].z;
+	}
+
+	std::nth_element(along.begin(), along.begin() + triCount / 2, along.end());
+
+	p.nx = axis == 0 ? FIX_ONE : 0;
+	p.ny = axis == 1 ? FIX_ONE : 0;
+	p.nz = axis == 2 ? FIX_ONE : 0;
+	p.d = along[triCount / 2];
+
+	return true;
+}
+
+void BspTree::Partition(const std::vector<unsigned int>& tris, const BspPlane& p, int splitter, std::vector<unsigned int>& front,
+	std::vector<unsigned int>& back, std::vector<unsigned int>& onFront, std::vector<unsigned int>& onBack)
+{
+	int triCount = (int)tris.size() / 3;
+
+	for (int t = 0; t < triCount; t++)
+	{
+		const unsigned int* tri = &tris[t * 3];
+		int pos = 0, neg = 0;
+
+		for (int k = 0; k < 3; k++)
+		{
+			fix16 d = Distance(p, verts[tri[k]]);
+			pos += d > BSP_EPSILON;
+			neg += d < -BSP_EPSILON;
+		}
+
+		// The splitter always lands on its own plane, even if rounding says otherwise
+		if (t == splitter || (!pos && !neg))
+		{
+			double n[3];
+			TriArea2(verts[tri[0]], verts[tri[1]], verts[tri[2]], n);
+
+			std::vector<unsigned int>& on = (n[0] * p.nx + n[1] * p.ny + n[2] * p.nz >= 0.0) ? onFront : onBack;
+			on.insert(on.end(), tri, tri + 3);
+		}
+		else if (!neg)
+		{
+			front.insert(front.end(), tri, tri + 3);
+		}
+		else if (!pos)
+		{
+			back.insert(back.end(), tri, tri + 3);
+		}
+		else
+		{
+			SplitTri(tri, p, front, back);
+		}
+	}
+}
+
+void BspTree::Unpartition(size_t vertCount, int splits, std::vector<unsigned int>& front, std::vector<unsigned int>& back,
+	std::vector<unsigned int>& onFront, std::vector<unsigned int>& onBack)
+{
+	verts.resize(vertCount);
+	splitCount = splits;
+	front.clear();
+	back.clear();
+	onFront.clear();
+	onBack.clear();
+}
+
+int BspTree::BuildNode(std::vector<unsigned int>& tris, int leafContents, long long work)
+{
+	// Worked through with a stack of our own rather than recursion, as trees can go very deep
+	std::vector<BspBuildTask> stack(1);
+	int root = 0;
+
+	stack[0].tris.swap(tris);
+	stack[0].leafContents = leafContents;
+	stack[0].work = work;
+	stack[0].parent = -1;
+	stack[0].front = true;
+	stack[0].node = -1;
+
+	while (!stack.empty())
+	{
+		BspBuildTask task = std::move(stack.back());
+		stack.pop_back();
+
+		if (task.node >= 0)
+		{
+			EndNode(task.node, nodes[task.node].front, nodes[task.node].back);
+			continue;
+		}
+
+		if (progress && progress->Cancelled())
+		{
+			task.tris.clear();
+		}
+
+		int child;
+
+		if (task.tris.empty())
+		{
+			child = AddLeaf(task.leafContents, task.work);
+		}
+		else
+		{
+			std::vector<unsigned int> front, back, onFront, onBack;
+			BspPlane p;
+			int triCount = (int)task.tris.size() / 3;
+
+			// Only the big nodes near the root get timed, there are far too many small ones
+			{
+				TRACE_SCOPE_IF(triCount >= TRACE_NODE_TRIS, "Splitting node");
+				size_t vertCount = verts.size();
+				int splits = splitCount;
+				int splitter = ChooseSplitter(task.tris);
+
+				MakePlane(&task.tris[splitter * 3], p);
+				Partition(task.tris, p, splitter, front, back, onFront, onBack);
+
+				// Every face of a convex piece has all the rest behind it, so its own planes would
+				// only ever peel one triangle off at a time. Big ones are cut down the middle instead.
+				BspPlane axis;
+
+				if (front.empty() != back.empty() && triCount > CHAIN_TRIS && AxisPlane(task.tris, axis))
+				{
+					Unpartition(vertCount, splits, front, back, onFront, onBack);
+					Partition(task.tris, axis, -1, front, back, onFront, onBack);
+
+					// Only if it leaves something either side, a plane with nothing on it can't say
+					// what an empty side would be, and only if it's made real headway. Splits can
+					// otherwise leave small pieces no smaller than they started.
+					size_t most = std::max(front.size(), back.size()) / 3;
+
+					if (front.empty() || back.empty() || most * 4 > (size_t)triCount * 3)
+					{
+						Unpartition(vertCount, splits, front, back, onFront, onBack);
+						Partition(task.tris, p, splitter, front, back, onFront, onBack);
+					}
+					else
+					{
+						p = axis;
+					}
+				}
+			}
+
+			// Nothing above needs the input any more, and there can be a lot of it stacked up
+			std::vector<unsigned int>().swap(task.tris);
+
+			child = BeginNode(p, onFront, onBack);
+
+			long long frontWork, backWork;
+			ShareWork(task.work, onFront.size() + onBack.size(), front.size(), back.size(), frontWork, backWork);
+
+			// Children go straight after their parent, so the front side comes off the stack first
+			stack.resize(stack.size() + 3);
+
+			BspBuildTask& finish = stack[stack.size() - 3];
+			finish.node = child;
+
+			BspBuildTask& backTask = stack[stack.size() - 2];
+			backTask.tris.swap(back);
+			backTask.leafContents = BSP_SOLID;
+			backTask.work = backWork;
+			backTask.parent = child;
+			backTask.front = false;
+			backTask.node = -1;
+
+			BspBuildTask& frontTask = stack[stack.size() - 1];
+			frontTask.tris.swap(front);
+			frontTask.leafContents = BSP_EMPTY;
+			frontTask.work = frontWork;
+			frontTask.parent = child;
+			frontTask.front = true;
+			frontTask.node = -1;
+		}
+
+		if (task.parent < 0)
+		{
+			root = child;
+		}
+		else if (task.front)
+		{
+			nodes[task.parent].front = child;
+		}
+		else
+		{
+			nodes[task.parent].back = child;
+		}
+	}
+
+	return root;
+}
+
+int BspTree::AddLeaf(int contents, long long work)
+{
+	if (progress)
+	{
+		progress->Advance(work);
+	}
+
+	BspLeaf leaf = { contents, -1 };
+	leaves.push_back(leaf);
+	return BSP_LEAF((int)leaves.size() - 1);
+}
+
+int BspTree::BeginNode(const BspPlane& p, const std::vector<unsigned int>& onFront, const std::vector<unsigned int>& onBack)
+{
+	BspNode node;
+
+	node.plane = (int)planes.size();
+	node.firstTri = (int)indices.size() / 3;
+	node.frontTriCount = (int)onFront.size() / 3;
+	node.backTriCount = (int)onBack.size() / 3;
+	node.front = node.back = BSP_LEAF(0);
+
+	// Inside out to start with, as a node cut through the middle of things has no triangles of
+	// its own and takes its bounds from its children
+	node.bounds.min.x = node.bounds.min.y = node.bounds.min.z = INT32_MAX;
+	node.bounds.max.x = node.bounds.max.y = node.bounds.max.z = INT32_MIN;
+
+	planes.push_back(p);
+	indices.insert(indices.end(), onFront.begin(), onFront.end());
+	indices.insert(indices.end(), onBack.begin(), onBack.end());
+
+	for (size_t i = 0; i < onFront.size(); i++)
+	{
+		GrowBounds(node.bounds, verts[onFront[i]]);
+	}
+
+	for (size_t i = 0; i < onBack.size(); i++)
+	{
+		GrowBounds(node.bounds, verts[onBack[i]]);
+	}
+
+	nodes.push_back(node);
+	return (int)nodes.size() - 1;
+}
+
+void BspTree::ShareWork(long long work, size_t on, size_t front, size_t back, long long& frontWork, long long& backWork)
+{
+	// Splits mean the children can hold more triangles than came in, so each side gets this
+	// node's share of the work in proportion to what it was given rather than a fixed amount
+	long long total = (long long)(on + front + back);
+
+	frontWork = work * (long long)front / total;
+	backWork = work * (long long)back / total;
+
+	if (progress)
+	{
+		progress->Advance(work - frontWork - backWork);
+	}
+}
+
+void BspTree::EndNode(int nodeIndex, int frontChild, int backChild)
+{
+	BspNode& n = nodes[nodeIndex];
+	n.front = frontChild;
+	n.back = backChild;
+	n.nodeEnd = (int)nodes.size();
+	n.triEnd = (int)indices.size() / 3;
+
+	if (frontChild >= 0)
+	{
+		GrowBounds(n.bounds, nodes[frontChild].bounds.min);
+		GrowBounds(n.bounds, nodes[frontChild].bounds.max);
+	}
+
+	if (backChild >= 0)
+	{
+		GrowBounds(n.bounds, nodes[backChild].bounds.min);
+		GrowBounds(n.bounds, nodes[backChild].bounds.max);
+	}
+}
+
+int BspTree::FindLeaf(const BspVec& v) const
+{
+	int child = nodes.empty() ? BSP_LEAF(0) : 0;
+
+	while (child >= 0)
+	{
+		const BspNode& node = nodes[child];
+		child = Distance(planes[node.plane], v) >= 0 ? node.front : node.back;
+	}
+
+	return BSP_LEAF(child);
+}
+
+bool BspTree::DecompressVis(int leaf, std::vector<unsigned char>& out) const
+{
+	int rowBytes = ((int)leaves.size() + 7) / 8;
+	int offset = leaves[leaf].visOffset;
+
+	if (offset < 0)
+	{
+		return false;
+	}
+
+	out.assign(rowBytes, 0);
+
+	for (int i = 0; i < rowBytes; )
+	{
+		unsigned char c = visData[offset++];
+
+		if (c)
+		{
+			out[i++] = c;
+		}
+		else
+		{
+			i += visData[offset++];
+		}
+	}
+
+	return true;
+}
+
+void BspTree::MarkVisibleNodes(int leaf, std::vector<unsigned char>& nodeVis) const
+{
+	std::vector<unsigned char> leafVis;
+	int nodeCount = (int)nodes.size();
+
+	nodeVis.assign(nodeCount, 1);
+
+	if (!DecompressVis(leaf, leafVis))
+	{
+		return;
+	}
+
+	// Children always come after their parent, so walking backwards sees them first
+	for (int i = nodeCount - 1; i >= 0; i--)
+	{
+		int children[2] = { nodes[i].front, nodes[i].back };
+
+		nodeVis[i] = 0;
+
+		for (int c = 0; c < 2; c++)
+		{
+			if (children[c] >= 0)
+			{
+				nodeVis[i] |= nodeVis[children[c]];
+			}
+			else
+			{
+				int l = BSP_LEAF(children[c]);
+				nodeVis[i] |= (leafVis[l >> 3] >> (l & 7)) & 1;
+			}
+		}
+	}
+}
+
+void BspTree::CollectVisible(const BspFrustum& frustum, const BspVec& eye, bool frustumCull, bool backfaceCull,
+	const unsigned char* nodeVis, std::vector<BspRange>& out, BspCullStats& stats) const
+{
+	int nodeCount = (int)nodes.size();
+	int insideEnd = 0;
+
+	out.clear();
+	stats.nodesVisited = stats.nodesCulled = stats.nodesPvsCulled = 0;
+	stats.trisFrustumCulled = stats.trisBackfaceCulled = stats.trisPvsCulled = stats.trisDrawn = 0;
+
+	// Pre-order storage means a straight walk over the array visits parents before children,
+	// and skipping a subtree is just a jump to its nodeEnd
+	for (int i = 0; i < nodeCount; )
+	{
+		const BspNode& node = nodes[i];
+
+		stats.nodesVisited++;
+
+		if (nodeVis && !nodeVis[i])
+		{
+			stats.nodesPvsCulled += node.nodeEnd - i;
+			stats.trisPvsCulled += node.triEnd - node.firstTri;
+			i = node.nodeEnd;
+			continue;
+		}
+
+		if (frustumCull && i >= insideEnd)
+		{
+			int result = frustum.Test(node.bounds);
+
+			if (result == BSP_OUTSIDE)
+			{
+				stats.nodesCulled += node.nodeEnd - i;
+				stats.trisFrustumCulled += node.triEnd - node.firstTri;
+				i = node.nodeEnd;
+				continue;
+			}
+
+			if (result == BSP_INSIDE)
+			{
+				insideEnd = node.nodeEnd;
+			}
+		}
+
+		if (!backfaceCull && !nodeVis)
+		{
+			if (!frustumCull || i < insideEnd)
+			{
+				// Nothing below here can be rejected, so draw the whole subtree in one go
+				AddRange(out, node.firstTri, node.triEnd - node.firstTri);
+				stats.trisDrawn += node.triEnd - node.firstTri;
+				i = node.nodeEnd;
+				continue;
+			}
+		}
+
+		if (!backfaceCull)
+		{
+			AddRange(out, node.firstTri, node.frontTriCount + node.backTriCount);
+			stats.trisDrawn += node.frontTriCount + node.backTriCount;
+		}
+		else if (Distance(planes[node.plane], eye) >= 0)
+		{
+			AddRange(out, node.firstTri, node.frontTriCount);
+			stats.trisDrawn += node.frontTriCount;
+			stats.trisBackfaceCulled += node.backTriCount;
+		}
+		else
+		{
+			AddRange(out, node.firstTri + node.frontTriCount, node.backTriCount);
+			stats.trisDrawn += node.backTriCount;
+			stats.trisBackfaceCulled += node.frontTriCount;
+		}
+
+		i++;
+	}
+}
+
+static void WriteLong(FILE* f, int32_t v)
+{
+	unsigned char b[4] = { (unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v };
+	fwrite(b, 1, 4, f);
+}
+
+static void WriteVec(FILE* f, const BspVec& v)
+{
+	WriteLong(f, v.x);
+	WriteLong(f, v.y);
+	WriteLong(f, v.z);
+}
+
+bool BspTree::Export(const char* filename) const
+{
+	TRACE_SCOPE("BspTree::Export");
+	MemScope mem(MEM_EXPORT);
+	FILE* f = fopen(filename, "wb");
+
+	if (!f)
+	{
+		return false;
+	}
+
+	WriteLong(f, EXPORT_MAGIC);
+	WriteLong(f, EXPORT_VERSION);
+	WriteLong(f, (int32_t)verts.size());
+	WriteLong(f, (int32_t)planes.size());
+	WriteLong(f, (int32_t)nodes.size());
+	WriteLong(f, (int32_t)leaves.size());
+	WriteLong(f, (int32_t)indices.size());
+	WriteLong(f, (int32_t)visData.size());
+	WriteLong(f, (int32_t)vertLight.size());
+
+	for (size_t i = 0; i < verts.size(); i++)
+	{
+		WriteVec(f, verts[i]);
+	}
+
+	for (size_t i = 0; i < planes.size(); i++)
+	{
+		WriteLong(f, planes[i].nx);
+		WriteLong(f, planes[i].ny);
+		WriteLong(f, planes[i].nz);
+		WriteLong(f, planes[i].d);
+	}
+
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const BspNode& n = nodes[i];
+
+		WriteLong(f, n.plane);
+		WriteLong(f, n.front);
+		WriteLong(f, n.back);
+		WriteLong(f, n.firstTri);
+		WriteLong(f, n.frontTriCount);
+		WriteLong(f, n.backTriCount);
+		WriteLong(f, n.nodeEnd);
+		WriteLong(f, n.triEnd);
+		WriteVec(f, n.bounds.min);
+		WriteVec(f, n.bounds.max);
+	}
+
+	for (size_t i = 0; i < leaves.size(); i++)
+	{
+		WriteLong(f, leaves[i].contents);
+		WriteLong(f, leaves[i].visOffset);
+	}
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		WriteLong(f, (int32_t)indices[i]);
+	}
+
+	fwrite(visData.data(), 1, visData.size(), f);
+	fwrite(vertLight.data(), 1, vertLight.size(), f);
+
+	bool ok = !ferror(f);
+	fclose(f);
+
+	return ok;
+}
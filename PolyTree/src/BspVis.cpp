@@ -0,0 +1,562 @@
+#include "BspVis.h"
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "MemTrack.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+// Clips target to the region a line through source and pass could reach, using the planes that
+// run through an edge of one and a point of the other with the two on opposite sides
+static bool ClipToSeparators(const VisWinding& source, const VisWinding& pass, VisWinding& target, bool flipClip)
+{
+	size_t sourceCount = source.size(), passCount = pass.size();
+
+	for (size_t i = 0; i < sourceCount; i++)
+	{
+		size_t l = (i + 1) % sourceCount;
+		VisPoint v1 = { source[l].x - source[i].x, source[l].y - source[i].y, source[l].z - source[i].z };
+
+		for (size_t j = 0; j < passCount; j++)
+		{
+			VisPoint v2 = { pass[j].x - source[i].x, pass[j].y - source[i].y, pass[j].z - source[i].z };
+			VisPlane p = { v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x, 0.0 };
+			double len = sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+
+			if (len < VIS_EPSILON)
+			{
+				continue;
+			}
+
+			p.x /= len;
+			p.y /= len;
+			p.z /= len;
+			p.d = p.x * pass[j].x + p.y * pass[j].y + p.z * pass[j].z;
+
+			// Which side of the candidate is the source on?
+			bool flipTest = false;
+			size_t k;
+
+			for (k = 0; k < sourceCount; k++)
+			{
+				if (k == i || k == l)
+				{
+					continue;
+				}
+
+				double d = PlaneDist(p, source[k]);
+
+				if (d < -VIS_EPSILON)
+				{
+					break;
+				}
+
+				if (d > VIS_EPSILON)
+				{
+					flipTest = true;
+					break;
+				}
+			}
+
+			if (k == sourceCount)
+			{
+				// Lies in the source plane
+				continue;
+			}
+
+			if (flipTest)
+			{
+				p = FlipPlane(p);
+			}
+
+			// Only a separator if the pass portal is entirely on the other side
+			int onFront = 0;
+
+			for (k = 0; k < passCount; k++)
+			{
+				if (k == j)
+				{
+					continue;
+				}
+
+				double d = PlaneDist(p, pass[k]);
+
+				if (d < -VIS_EPSILON)
+				{
+					break;
+				}
+
+				onFront += d > VIS_EPSILON;
+			}
+
+			if (k != passCount || !onFront)
+			{
+				continue;
+			}
+
+			if (flipClip)
+			{
+				p = FlipPlane(p);
+			}
+
+			if (!ChopWinding(target, p))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool TestBit(const std::vector<unsigned char>& bits, int i)
+{
+	return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+static void SetBit(std::vector<unsigned char>& bits, int i)
+{
+	bits[i >> 3] |= 1 << (i & 7);
+}
+
+BspVis::BspVis()
+{
+	threadCount = HardwareThreads();
+	visSeconds = 0.0;
+	averageVisible = 0.0;
+	outsideLeaves = 0;
+	rowBytes = 0;
+	portalDone = NULL;
+	progress = NULL;
+}
+
+void BspVis::FillOutside(const BspTree& tree, const BspPortals& portalSet, std::vector<unsigned char>& outside)
+{
+	const std::vector<BspPortal>& portals = portalSet.portals;
+	std::vector<std::vector<int> > neighbours(tree.leaves.size());
+	std::vector<int> stack;
+
+	outside.assign(tree.leaves.size(), 0);
+	outsideLeaves = 0;
+
+	for (size_t i = 0; i < portals.size(); i++)
+	{
+		neighbours[portals[i].leaves[0]].push_back(portals[i].leaves[1]);
+		neighbours[portals[i].leaves[1]].push_back(portals[i].leaves[0]);
+	}
+
+	for (size_t i = 0; i < tree.leaves.size(); i++)
+	{
+		if (tree.leaves[i].contents == BSP_EMPTY && portalSet.cells[i].outside)
+		{
+			outside[i] = 1;
+			stack.push_back((int)i);
+		}
+	}
+
+	while (!stack.empty())
+	{
+		int leaf = stack.back();
+		stack.pop_back();
+		outsideLeaves++;
+
+		for (size_t i = 0; i < neighbours[leaf].size(); i++)
+		{
+			int next = neighbours[leaf][i];
+
+			if (!outside[next])
+			{
+				outside[next] = 1;
+				stack.push_back(next);
+			}
+		}
+	}
+}
+
+void BspVis::BasePortalVis(int p)
+{
+	FlowPortal& base = flowPortals[p];
+	std::vector<unsigned char> inFront(flowPortals.size(), 0);
+	std::vector<int> stack;
+
+	// A portal can only ever lead on to portals at least partly in front of it, which in turn
+	// have this one at least partly behind them
+	for (size_t t = 0; t < flowPortals.size(); t++)
+	{
+		const FlowPortal& other = flowPortals[t];
+		size_t k;
+
+		if ((int)t == p)
+		{
+			continue;
+		}
+
+		for (k = 0; k < other.winding->size(); k++)
+		{
+			if (PlaneDist(base.plane, (*other.winding)[k]) > VIS_EPSILON)
+			{
+				break;
+			}
+		}
+
+		if (k == other.winding->size())
+		{
+			continue;
+		}
+
+		for (k = 0; k < base.winding->size(); k++)
+		{
+			if (PlaneDist(other.plane, (*base.winding)[k]) < -VIS_EPSILON)
+			{
+				break;
+			}
+		}
+
+		if (k == base.winding->size())
+		{
+			continue;
+		}
+
+		inFront[t] = 1;
+	}
+
+	base.mightSee.assign(rowBytes, 0);
+	SetBit(base.mightSee, base.leaf);
+	stack.push_back(base.leaf);
+
+	while (!stack.empty())
+	{
+		int leaf = stack.back();
+		stack.pop_back();
+
+		for (size_t i = 0; i < leafPortals[leaf].size(); i++)
+		{
+			int next = leafPortals[leaf][i];
+
+			if (inFront[next] && !TestBit(base.mightSee, flowPortals[next].leaf))
+			{
+				SetBit(base.mightSee, flowPortals[next].leaf);
+				stack.push_back(flowPortals[next].leaf);
+			}
+		}
+	}
+}
+
+void BspVis::RecursiveLeafFlow(int base, int leafIndex, const FlowStack& prev, std::vector<unsigned char>& vis) const
+{
+	const std::vector<int>& leafOut = leafPortals[leafIndex];
+	FlowStack stack;
+
+	SetBit(vis, leafIndex);
+
+	for (size_t i = 0; i < leafOut.size(); i++)
+	{
+		// A single flow can take a long time on its own, so cancelling doesn't wait for it
+		if (progress && progress->Cancelled())
+		{
+			return;
+		}
+
+		const FlowPortal& p = flowPortals[leafOut[i]];
+		bool done = portalDone[leafOut[i]].load(std::memory_order_acquire) != 0;
+		const std::vector<unsigned char>& test = done ? portalVis[leafOut[i]] : p.mightSee;
+		bool more = false;
+
+		if (!TestBit(prev.mightSee, p.leaf))
+		{
+			continue;
+		}
+
+		stack.mightSee.resize(rowBytes);
+
+		for (int j = 0; j < rowBytes; j++)
+		{
+			stack.mightSee[j] = prev.mightSee[j] & test[j];
+			more |= (stack.mightSee[j] & ~vis[j]) != 0;
+		}
+
+		if (!more && TestBit(vis, p.leaf))
+		{
+			continue;
+		}
+
+		stack.plane = p.plane;
+
+		// Only the part of the next portal beyond the base one can be seen through it
+		stack.pass = *p.winding;
+
+		if (!ChopWinding(stack.pass, flowPortals[base].plane))
+		{
+			continue;
+		}
+
+		// and only the part of the source behind the next portal can see through it
+		stack.source = prev.source;
+
+		if (!ChopWinding(stack.source, FlipPlane(p.plane)))
+		{
+			continue;
+		}
+
+		if (prev.pass.empty())
+		{
+			// Nothing to clip against yet, the neighbours of the source are always visible
+			RecursiveLeafFlow(base, p.leaf, stack, vis);
+			continue;
+		}
+
+		if (!ChopWinding(stack.pass, prev.plane))
+		{
+			continue;
+		}
+
+		if (!ClipToSeparators(stack.source, prev.pass, stack.pass, false))
+		{
+			continue;
+		}
+
+		if (!ClipToSeparators(prev.pass, stack.source, stack.pass, true))
+		{
+			continue;
+		}
+
+		RecursiveLeafFlow(base, p.leaf, stack, vis);
+	}
+}
+
+void BspVis::PortalFlow(int base, std::vector<unsigned char>& vis) const
+{
+	const FlowPortal& p = flowPortals[base];
+	FlowStack head;
+
+	head.source = *p.winding;
+	head.plane = p.plane;
+	head.mightSee = p.mightSee;
+
+	vis.assign(rowBytes, 0);
+	RecursiveLeafFlow(base, p.leaf, head, vis);
+}
+
+void BspVis::LeafVis(int leaf, std::vector<unsigned char>& vis)
+{
+	vis.assign(rowBytes, 0);
+	SetBit(vis, leaf);
+
+	for (size_t i = 0; i < leafPortals[leaf].size(); i++)
+	{
+		int p = leafPortals[leaf][i];
+
+		PortalFlow(p, portalVis[p]);
+
+		// A flow cut short by cancelling isn't a bound anyone else can use
+		if (progress && progress->Cancelled())
+		{
+			return;
+		}
+
+		portalDone[p].store(1, std::memory_order_release);
+
+		for (int j = 0; j < rowBytes; j++)
+		{
+			vis[j] |= portalVis[p][j];
+		}
+	}
+}
+
+void BspVis::Build(BspTree& tree, const BspPortals& portalSet)
+{
+	TRACE_SCOPE("BspVis::Build");
+	MemScope mem(MEM_VIS);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	const std::vector<BspPortal>& portals = portalSet.portals;
+	int leafCount = (int)tree.leaves.size();
+
+	// Everything that can be reached from outside the model is left out of the flow altogether.
+	// Nobody looks in from out there, and the open space around a model is what takes forever.
+	std::vector<unsigned char> outside;
+	std::vector<int> inside;
+
+	FillOutside(tree, portalSet, outside);
+
+	for (size_t i = 0; i < portals.size(); i++)
+	{
+		if (!outside[portals[i].leaves[0]])
+		{
+			inside.push_back((int)i);
+		}
+	}
+
+	// Each portal gets flowed in both directions, looking out of one leaf into the other
+	rowBytes = (leafCount + 7) / 8;
+	flowPortals.resize(inside.size() * 2);
+	leafPortals.assign(leafCount, std::vector<int>());
+
+	for (size_t i = 0; i < inside.size(); i++)
+	{
+		const BspPortal& portal = portals[inside[i]];
+		FlowPortal& intoFront = flowPortals[i * 2];
+		FlowPortal& intoBack = flowPortals[i * 2 + 1];
+
+		intoFront.winding = intoBack.winding = &portal.winding;
+		intoFront.plane = portal.plane;
+		intoFront.leaf = portal.leaves[0];
+		intoFront.owner = portal.leaves[1];
+		intoBack.plane = FlipPlane(portal.plane);
+		intoBack.leaf = portal.leaves[1];
+		intoBack.owner = portal.leaves[0];
+
+		leafPortals[intoFront.owner].push_back((int)i * 2);
+		leafPortals[intoBack.owner].push_back((int)i * 2 + 1);
+	}
+
+	if (progress)
+	{
+		progress->Begin("Base visibility", (long long)flowPortals.size());
+	}
+
+	{
+		TRACE_SCOPE("Base visibility");
+
+		ParallelFor((int)flowPortals.size(), threadCount, [this](int p)
+		{
+			if (progress && progress->Cancelled())
+			{
+				flowPortals[p].mightSee.assign(rowBytes, 0);
+				return;
+			}
+
+			TRACE_SCOPE("BasePortalVis");
+			BasePortalVis(p);
+
+			if (progress)
+			{
+				progress->Advance();
+			}
+		});
+	}
+
+	// Leaves that might see the least finish quickest, and their results then prune everyone else's flow
+	std::vector<int> order;
+	std::vector<int> cost(leafCount, 0);
+
+	for (int i = 0; i < leafCount; i++)
+	{
+		if (tree.leaves[i].contents != BSP_EMPTY || outside[i])
+		{
+			continue;
+		}
+
+		for (size_t j = 0; j < leafPortals[i].size(); j++)
+		{
+			const std::vector<unsigned char>& might = flowPortals[leafPortals[i][j]].mightSee;
+
+			for (int k = 0; k < rowBytes; k++)
+			{
+				for (unsigned char c = might[k]; c; c &= c - 1)
+				{
+					cost[i]++;
+				}
+			}
+		}
+
+		order.push_back(i);
+	}
+
+	std::sort(order.begin(), order.end(), [&cost](int a, int b) { return cost[a] < cost[b]; });
+
+	std::vector<std::vector<unsigned char> > rows(leafCount);
+	portalVis.assign(flowPortals.size(), std::vector<unsigned char>());
+	portalDone = new std::atomic<int>[flowPortals.size() + 1];
+
+	for (size_t i = 0; i < flowPortals.size(); i++)
+	{
+		portalDone[i].store(0);
+	}
+
+	if (progress)
+	{
+		progress->Begin("Flowing visibility", (long long)order.size());
+	}
+
+	{
+		TRACE_SCOPE("Flowing visibility");
+
+		ParallelFor((int)order.size(), threadCount, [&](int i)
+		{
+			if (progress && progress->Cancelled())
+			{
+				return;
+			}
+
+			TRACE_SCOPE("LeafVis");
+			LeafVis(order[i], rows[order[i]]);
+
+			if (progress)
+			{
+				// Cut short, so the leaf is better off with no PVS than one that's missing leaves
+				if (progress->Cancelled())
+				{
+					std::vector<unsigned char>().swap(rows[order[i]]);
+					return;
+				}
+
+				progress->Advance();
+			}
+		});
+	}
+
+	delete[] portalDone;
+	portalDone = NULL;
+
+	// Compress, zero bytes turning into a zero and a run length
+	long visibleTotal = 0;
+	tree.visData.clear();
+
+	for (int i = 0; i < leafCount; i++)
+	{
+		const std::vector<unsigned char>& row = rows[i];
+
+		if (row.empty())
+		{
+			tree.leaves[i].visOffset = -1;
+			continue;
+		}
+
+		tree.leaves[i].visOffset = (int)tree.visData.size();
+
+		for (int j = 0; j < rowBytes; j++)
+		{
+			for (unsigned char c = row[j]; c; c &= c - 1)
+			{
+				visibleTotal++;
+			}
+
+			if (row[j])
+			{
+				tree.visData.push_back(row[j]);
+				continue;
+			}
+
+			int run = 1;
+
+			while (j + run < rowBytes && !row[j + run] && run < 255)
+			{
+				run++;
+			}
+
+			tree.visData.push_back(0);
+			tree.visData.push_back((unsigned char)run);
+			j += run - 1;
+		}
+	}
+
+	averageVisible = order.empty() ? 0.0 : (double)visibleTotal / order.size();
+
+	// The flow data is only needed while building
+	std::vector<FlowPortal>().swap(flowPortals);
+	std::vector<std::vector<unsigned char> >().swap(portalVis);
+
+	visSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
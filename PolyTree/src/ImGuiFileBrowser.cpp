@@ -13,6 +13,8 @@
 #include <cctype>
 #include <algorithm>
 #include <cmath>
+#include <thread>
+#include <sys/stat.h>
 #if defined (WIN32) || defined (_WIN32) || defined (__WIN32)
 #define OSWIN
 #ifndef NOMINMAX
@@ -24,6 +26,10 @@
 #include <dirent.h>
 #endif // defined (WIN32) || defined (_WIN32)
 
+// Entries read before handing a batch over to the UI, and how many directory listings to keep around
+#define SCAN_BATCH_SIZE 1024
+#define DIR_CACHE_SIZE 32
+
 namespace imgui_addons
 {
     ImGuiFileBrowser::ImGuiFileBrowser()
@@ -49,6 +55,7 @@ namespace imgui_addons
         selected_fn = "";
         selected_path = "";
         input_fn[0] = '\0';
+        dir_cache_clock = 0;
 
         #ifdef OSWIN
         current_path = "./";
@@ -59,7 +66,7 @@ namespace imgui_addons
 
     ImGuiFileBrowser::~ImGuiFileBrowser()
     {
-
+        cancelScan();
     }
 
     void ImGuiFileBrowser::clearFileList()
@@ -101,6 +108,7 @@ namespace imgui_addons
         //Now clear subdirs and subfiles
         subdirs.clear();
         subfiles.clear();
+        cancelScan();
 
         ImGui::CloseCurrentPopup();
     }
@@ -154,6 +162,8 @@ namespace imgui_addons
                 is_appearing = false;
             }
 
+            pollScan();
+
             show_error |= renderNavAndSearchBarRegion();
             show_error |= renderFileListRegion();
             show_error |= renderInputTextAndExtRegion();
@@ -394,11 +404,24 @@ namespace imgui_addons
                         validate_file = true;
                     }
                 }
+                if(file_tooltip && ImGui::IsItemHovered())
+                    file_tooltip(current_path + filtered_files[i]->name);
                 if( (items) % col_items_limit == 0)
                     ImGui::NextColumn();
             }
         }
         ImGui::Columns(1);
+
+        //Overlay the scan's progress in the bottom right corner so the list layout doesn't move around
+        if(dir_scan)
+        {
+            char scan_text[64];
+            snprintf(scan_text, sizeof(scan_text), "Scanning... %d items", (int)(subdirs.size() + subfiles.size()));
+            ImVec2 text_size = ImGui::CalcTextSize(scan_text);
+            ImVec2 text_pos = ImGui::GetWindowPos() + ImGui::GetWindowSize() - text_size - style.WindowPadding;
+            ImGui::GetWindowDrawList()->AddText(text_pos, ImGui::GetColorU32(ImGuiCol_TextDisabled), scan_text);
+        }
+
         ImGui::EndChild();
 
         return show_error;
@@ -752,7 +775,6 @@ namespace imgui_addons
     bool ImGuiFileBrowser::readDIR(std::string pathdir)
     {
         DIR* dir;
-        struct dirent *ent;
 
         /* If the current directory doesn't exist, and we are opening the dialog for the first time, reset to defaults to avoid looping of showing error modal.
          * An example case is when user closes the dialog in a folder. Then deletes the folder outside. On reopening the dialog the current path (previous) would be invalid.
@@ -790,57 +812,188 @@ namespace imgui_addons
             }
             #endif // OSWIN
 
-            // store all the files and directories within directory and clear previous entries
-            clearFileList();
-            while ((ent = readdir (dir)) != nullptr)
-            {
-                bool is_hidden = false;
-                std::string name(ent->d_name);
+            // Reading the entries is what takes the time on big directories, so that and the sorting happen on another thread
+            closedir(dir);
+            startScan(pathdir);
+        }
+        else
+        {
+            error_title = "Error!";
+            error_msg = "Error opening directory! Make sure the directory exists and you have the proper rights to access the directory.";
+            return false;
+        }
+        return true;
+    }
 
-                //Ignore current directory
-                if(name == ".")
-                    continue;
+    void ImGuiFileBrowser::startScan(const std::string& pathdir)
+    {
+        cancelScan();
+        clearFileList();
+
+        struct stat st;
+        time_t mtime = stat(pathdir.c_str(), &st) == 0 ? st.st_mtime : 0;
 
-                //Somehow there is a '..' present in root directory in linux.
-                #ifndef OSWIN
-                if(name == ".." && pathdir == "/")
+        //Adding, removing or renaming anything in a directory updates its modification time, so an unchanged one can reuse its listing
+        auto cached = dir_cache.find(pathdir);
+        if(cached != dir_cache.end() && mtime != 0 && cached->second.mtime == mtime)
+        {
+            cached->second.last_used = ++dir_cache_clock;
+            applyListing(cached->second.listing);
+            return;
+        }
+
+        dir_scan = std::make_shared<DirScan>();
+        dir_scan->path = pathdir;
+        dir_scan->mtime = mtime;
+
+        //The thread holds on to its own reference, so abandoning a scan just means flagging it and letting it finish on its own
+        std::thread(scanDIR, dir_scan).detach();
+    }
+
+    void ImGuiFileBrowser::cancelScan()
+    {
+        if(dir_scan)
+        {
+            dir_scan->cancelled = true;
+            dir_scan.reset();
+        }
+    }
+
+    void ImGuiFileBrowser::scanDIR(std::shared_ptr<DirScan> scan)
+    {
+        DirListing listing;
+        size_t dirs_sent = 0, files_sent = 0;
+        const std::string& pathdir = scan->path;
+        struct dirent *ent;
+
+        DIR* dir = opendir(pathdir.c_str());
+        while (dir != nullptr && !scan->cancelled && (ent = readdir (dir)) != nullptr)
+        {
+            bool is_hidden = false;
+            std::string name(ent->d_name);
+
+            //Ignore current directory
+            if(name == ".")
+                continue;
+
+            //Somehow there is a '..' present in root directory in linux.
+            #ifndef OSWIN
+            if(name == ".." && pathdir == "/")
+                continue;
+            #endif // OSWIN
+
+            if(name != "..")
+            {
+                #ifdef OSWIN
+                std::string dir = pathdir + std::string(ent->d_name);
+                // IF system file skip it...
+                if (FILE_ATTRIBUTE_SYSTEM & GetFileAttributesA(dir.c_str()))
                     continue;
+                if (FILE_ATTRIBUTE_HIDDEN & GetFileAttributesA(dir.c_str()))
+                    is_hidden = true;
+                #else
+                if(name[0] == '.')
+                    is_hidden = true;
                 #endif // OSWIN
+            }
+            //Store directories and files in separate vectors. Files are kept even for directory selection so the listing can be cached for any mode.
+            if(ent->d_type == DT_DIR)
+                listing.dirs.push_back(Info(name, is_hidden));
+            else if(ent->d_type == DT_REG)
+                listing.files.push_back(Info(name, is_hidden));
 
-                if(name != "..")
-                {
-                    #ifdef OSWIN
-                    std::string dir = pathdir + std::string(ent->d_name);
-                    // IF system file skip it...
-                    if (FILE_ATTRIBUTE_SYSTEM & GetFileAttributesA(dir.c_str()))
-                        continue;
-                    if (FILE_ATTRIBUTE_HIDDEN & GetFileAttributesA(dir.c_str()))
-                        is_hidden = true;
-                    #else
-                    if(name[0] == '.')
-                        is_hidden = true;
-                    #endif // OSWIN
-                }
-                //Store directories and files in separate vectors
-                if(ent->d_type == DT_DIR)
-                    subdirs.push_back(Info(name, is_hidden));
-                else if(ent->d_type == DT_REG && dialog_mode != DialogMode::SELECT)
-                    subfiles.push_back(Info(name, is_hidden));
+            if(listing.dirs.size() + listing.files.size() - dirs_sent - files_sent >= SCAN_BATCH_SIZE)
+            {
+                std::lock_guard<std::mutex> lock(scan->mutex);
+                scan->batch.dirs.insert(scan->batch.dirs.end(), listing.dirs.begin() + dirs_sent, listing.dirs.end());
+                scan->batch.files.insert(scan->batch.files.end(), listing.files.begin() + files_sent, listing.files.end());
+                dirs_sent = listing.dirs.size();
+                files_sent = listing.files.size();
             }
+        }
+
+        if(dir != nullptr)
             closedir (dir);
-            std::sort(subdirs.begin(), subdirs.end(), alphaSortComparator);
-            std::sort(subfiles.begin(), subfiles.end(), alphaSortComparator);
 
-            //Initialize Filtered dirs and files
-            filterFiles(filter_mode);
+        if(scan->cancelled)
+            return;
+
+        std::sort(listing.dirs.begin(), listing.dirs.end(), alphaSortComparator);
+        std::sort(listing.files.begin(), listing.files.end(), alphaSortComparator);
+
+        std::lock_guard<std::mutex> lock(scan->mutex);
+        scan->result.dirs.swap(listing.dirs);
+        scan->result.files.swap(listing.files);
+        scan->done = true;
+    }
+
+    void ImGuiFileBrowser::pollScan()
+    {
+        if(!dir_scan)
+            return;
+
+        DirListing batch;
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(dir_scan->mutex);
+            batch.dirs.swap(dir_scan->batch.dirs);
+            batch.files.swap(dir_scan->batch.files);
+            done = dir_scan->done;
         }
-        else
+
+        if(done)
         {
-            error_title = "Error!";
-            error_msg = "Error opening directory! Make sure the directory exists and you have the proper rights to access the directory.";
-            return false;
+            if(dir_scan->mtime != 0)
+            {
+                //Make room by dropping whichever listing has gone longest without a visit
+                if(dir_cache.size() >= DIR_CACHE_SIZE && dir_cache.find(dir_scan->path) == dir_cache.end())
+                {
+                    auto oldest = dir_cache.begin();
+                    for(auto it = dir_cache.begin(); it != dir_cache.end(); ++it)
+                    {
+                        if(it->second.last_used < oldest->second.last_used)
+                            oldest = it;
+                    }
+                    dir_cache.erase(oldest);
+                }
+
+                DirCacheEntry& entry = dir_cache[dir_scan->path];
+                entry.mtime = dir_scan->mtime;
+                entry.last_used = ++dir_cache_clock;
+                entry.listing.dirs.swap(dir_scan->result.dirs);
+                entry.listing.files.swap(dir_scan->result.files);
+                dir_scan.reset();
+                applyListing(entry.listing);
+            }
+            else
+            {
+                std::shared_ptr<DirScan> scan = dir_scan;
+                dir_scan.reset();
+                applyListing(scan->result);
+            }
+            return;
         }
-        return true;
+
+        if(batch.dirs.empty() && batch.files.empty())
+            return;
+
+        //Appending can move the entries, which leaves the filtered pointers and input bar references dangling until they're rebuilt
+        inputcb_filter_files.clear();
+        subdirs.insert(subdirs.end(), batch.dirs.begin(), batch.dirs.end());
+        if(dialog_mode != DialogMode::SELECT)
+            subfiles.insert(subfiles.end(), batch.files.begin(), batch.files.end());
+        filterFiles(filter_mode);
+    }
+
+    void ImGuiFileBrowser::applyListing(const DirListing& listing)
+    {
+        clearFileList();
+        subdirs = listing.dirs;
+        if(dialog_mode != DialogMode::SELECT)
+            subfiles = listing.files;
+
+        //Initialize Filtered dirs and files
+        filterFiles(filter_mode);
     }
 
     void ImGuiFileBrowser::filterFiles(int filter_mode)
@@ -1130,6 +1283,7 @@ namespace imgui_addons
             return false;
         }
 
+        cancelScan();
         clearFileList();
         char* temp = drives;
         for(char *drv = nullptr; *temp != '\0'; temp++)
@@ -0,0 +1,218 @@
+#include "MemTrack.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+// Keeps what follows aligned for anything malloc would have been asked for
+#define MEM_HEADER 16
+
+static const char* tagNames[MEM_TAG_COUNT] = { "Other", "Loader", "BSP build", "Portals & vis", "Collision & light", "Export", "GL buffers" };
+
+// A cache line each, stages running on different threads don't fight over one
+struct alignas(64) MemCounters
+{
+	std::atomic<long long> current;
+	std::atomic<long long> peak;
+	std::atomic<long long> markPeak;
+	std::atomic<long long> allocs;
+};
+
+struct MemHeader
+{
+	size_t size;
+	int tag;
+};
+
+// Zero initialised before anything runs, so allocations from other static constructors are fine
+static MemCounters counters[MEM_TAG_COUNT];
+static MemCounters total;
+
+static thread_local MemTag currentTag = MEM_OTHER;
+
+static void Raise(std::atomic<long long>& peak, long long value)
+{
+	long long p = peak.load(std::memory_order_relaxed);
+
+	while (value > p && !peak.compare_exchange_weak(p, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+static void Count(MemTag tag, long long bytes)
+{
+	MemCounters& c = counters[tag];
+	long long now = c.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	long long totalNow = total.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+	if (bytes > 0)
+	{
+		Raise(c.peak, now);
+		Raise(c.markPeak, now);
+		Raise(total.peak, totalNow);
+		Raise(total.markPeak, totalNow);
+		c.allocs.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+MemTag MemTrack::Current()
+{
+	return currentTag;
+}
+
+void MemTrack::SetCurrent(MemTag tag)
+{
+	currentTag = tag;
+}
+
+void MemTrack::Add(MemTag tag, long long bytes)
+{
+	Count(tag, bytes);
+}
+
+void MemTrack::Sub(MemTag tag, long long bytes)
+{
+	Count(tag, -bytes);
+}
+
+MemStats MemTrack::Stats(MemTag tag)
+{
+	MemStats s;
+	s.current = counters[tag].current.load(std::memory_order_relaxed);
+	s.peak = counters[tag].peak.load(std::memory_order_relaxed);
+	s.markPeak = counters[tag].markPeak.load(std::memory_order_relaxed);
+	s.allocs = counters[tag].allocs.load(std::memory_order_relaxed);
+	return s;
+}
+
+long long MemTrack::TotalCurrent()
+{
+	return total.current.load(std::memory_order_relaxed);
+}
+
+long long MemTrack::TotalPeak()
+{
+	return total.peak.load(std::memory_order_relaxed);
+}
+
+void MemTrack::Mark()
+{
+	for (int i = 0; i < MEM_TAG_COUNT; i++)
+	{
+		counters[i].markPeak = counters[i].current.load();
+	}
+
+	total.markPeak = total.current.load();
+}
+
+const char* MemTrack::TagName(MemTag tag)
+{
+	return tagNames[tag];
+}
+
+void MemTrack::Report(FILE* f)
+{
+	fprintf(f, "%-20s %12s %12s %12s\n", "Memory", "Current MB", "Peak MB", "Allocs");
+
+	for (int i = 0; i < MEM_TAG_COUNT; i++)
+	{
+		MemStats s = Stats((MemTag)i);
+		fprintf(f, "%-20s %12.1f %12.1f %12lld\n", tagNames[i], s.current / (1024.0 * 1024.0), s.peak / (1024.0 * 1024.0), s.allocs);
+	}
+
+	fprintf(f, "%-20s %12.1f %12.1f\n", "Total", TotalCurrent() / (1024.0 * 1024.0), TotalPeak() / (1024.0 * 1024.0));
+}
+
+#ifndef POLYTREE_NO_MEMTRACK
+
+static void* TrackedAlloc(size_t size)
+{
+	MemTag tag = currentTag;
+	MemHeader* h = (MemHeader*)malloc(size + MEM_HEADER);
+
+	if (!h)
+	{
+		// Worth knowing who had it all before the bad_alloc takes us down
+		fprintf(stderr, "Out of memory allocating %zu bytes for %s\n", size, tagNames[tag]);
+		MemTrack::Report(stderr);
+		return NULL;
+	}
+
+	h->size = size;
+	h->tag = tag;
+	Count(tag, (long long)size);
+
+	return (unsigned char*)h + MEM_HEADER;
+}
+
+static void TrackedFree(void* p)
+{
+	if (!p)
+	{
+		return;
+	}
+
+	MemHeader* h = (MemHeader*)((unsigned char*)p - MEM_HEADER);
+
+	Count((MemTag)h->tag, -(long long)h->size);
+	free(h);
+}
+
+void* operator new(size_t size)
+{
+	void* p = TrackedAlloc(size);
+
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	TrackedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	TrackedFree(p);
+}
+
+#endif
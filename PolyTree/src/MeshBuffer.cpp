@@ -0,0 +1,364 @@
+#include "MeshBuffer.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+#include "MemTrack.h"
+#include "Trace.h"
+
+#define INITIAL_VERTS (64 * 1024)
+#define INITIAL_INDICES (256 * 1024)
+
+#define UPLOAD_CHUNK (1024 * 1024)
+#define DEFAULT_UPLOAD_BUDGET (8 * UPLOAD_CHUNK)
+
+OffsetAllocator::OffsetAllocator()
+{
+	capacity = 0;
+	used = 0;
+}
+
+void OffsetAllocator::Reset(size_t size)
+{
+	freeBlocks.clear();
+	capacity = size;
+	used = 0;
+
+	if (size)
+	{
+		freeBlocks[0] = size;
+	}
+}
+
+void OffsetAllocator::Grow(size_t newCapacity)
+{
+	if (newCapacity <= capacity)
+	{
+		return;
+	}
+
+	size_t old = capacity;
+	capacity = newCapacity;
+	Free(old, newCapacity - old);
+	used += newCapacity - old;
+}
+
+long long OffsetAllocator::Alloc(size_t count)
+{
+	for (std::map<size_t, size_t>::iterator it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+	{
+		if (it->second < count)
+		{
+			continue;
+		}
+
+		size_t offset = it->first, size = it->second;
+
+		freeBlocks.erase(it);
+
+		if (size > count)
+		{
+			freeBlocks[offset + count] = size - count;
+		}
+
+		used += count;
+		return (long long)offset;
+	}
+
+	return -1;
+}
+
+void OffsetAllocator::Free(size_t offset, size_t count)
+{
+	if (!count)
+	{
+		return;
+	}
+
+	std::map<size_t, size_t>::iterator next = freeBlocks.lower_bound(offset);
+
+	used -= count;
+
+	// Merge with the block after, then the one before
+	if (next != freeBlocks.end() && offset + count == next->first)
+	{
+		count += next->second;
+		next = freeBlocks.erase(next);
+	}
+
+	if (next != freeBlocks.begin())
+	{
+		std::map<size_t, size_t>::iterator prev = next;
+		--prev;
+
+		if (prev->first + prev->second == offset)
+		{
+			prev->second += count;
+			return;
+		}
+	}
+
+	freeBlocks[offset] = count;
+}
+
+MeshBuffer::MeshBuffer()
+{
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &lightVBO);
+	glGenBuffers(1, &EBO);
+	glGenBuffers(1, &stagingBuffer);
+
+	verts.Reset(INITIAL_VERTS);
+	indices.Reset(INITIAL_INDICES);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, INITIAL_VERTS * sizeof(float) * 3, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
+	glBufferData(GL_ARRAY_BUFFER, INITIAL_VERTS, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ARRAY_BUFFER, INITIAL_INDICES * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, stagingBuffer);
+	glBufferData(GL_ARRAY_BUFFER, UPLOAD_CHUNK, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	SetupAttributes();
+	MemTrack::Add(MEM_GL, Bytes() + UPLOAD_CHUNK);
+
+	uploadBudget = DEFAULT_UPLOAD_BUDGET;
+	uploadedBytes = 0;
+	uploadSeconds = 0.0;
+	frameBytes = 0;
+}
+
+MeshBuffer::~MeshBuffer()
+{
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &lightVBO);
+	glDeleteBuffers(1, &EBO);
+	glDeleteBuffers(1, &stagingBuffer);
+
+	MemTrack::Sub(MEM_GL, Bytes() + UPLOAD_CHUNK);
+}
+
+void MeshBuffer::SetupAttributes()
+{
+	glBindVertexArray(VAO);
+
+	// vertex positions
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
+
+	// baked light, switched on per draw for meshes that have some
+	glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
+	glVertexAttribPointer(1, 1, GL_UNSIGNED_BYTE, GL_TRUE, 1, (void*)0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffer::GrowBuffer(unsigned int& buffer, size_t oldBytes, size_t newBytes)
+{
+	unsigned int grown;
+
+	// Copied across on the GPU, nothing comes back to the CPU
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &buffer);
+	buffer = grown;
+
+	// Both copies were around for a moment, which is what the peak wants to see
+	MemTrack::Add(MEM_GL, (long long)newBytes);
+	MemTrack::Sub(MEM_GL, (long long)oldBytes);
+}
+
+void MeshBuffer::Reserve(size_t vertCount, size_t indexCount)
+{
+	bool grown = false;
+
+	// Doubling, plus whatever this mesh needs in case it's bigger than everything so far
+	if (vertCount)
+	{
+		size_t size = verts.capacity * 2 + vertCount;
+
+		GrowBuffer(VBO, verts.capacity * sizeof(float) * 3, size * sizeof(float) * 3);
+		GrowBuffer(lightVBO, verts.capacity, size);
+		verts.Grow(size);
+		grown = true;
+	}
+
+	if (indexCount)
+	{
+		size_t size = indices.capacity * 2 + indexCount;
+
+		GrowBuffer(EBO, indices.capacity * sizeof(unsigned int), size * sizeof(unsigned int));
+		indices.Grow(size);
+		grown = true;
+	}
+
+	if (grown)
+	{
+		SetupAttributes();
+	}
+}
+
+void MeshBuffer::Add(const BspTree& bsp, MeshSlot& slot)
+{
+	MemScope mem(MEM_GL);
+	long long firstVert = verts.Alloc(bsp.verts.size());
+	long long firstIndex = indices.Alloc(bsp.indices.size());
+
+	if (firstVert < 0 || firstIndex < 0)
+	{
+		Reserve(firstVert < 0 ? bsp.verts.size() : 0, firstIndex < 0 ? bsp.indices.size() : 0);
+
+		firstVert = firstVert < 0 ? verts.Alloc(bsp.verts.size()) : firstVert;
+		firstIndex = firstIndex < 0 ? indices.Alloc(bsp.indices.size()) : firstIndex;
+	}
+
+	slot.baseVertex = (int)firstVert;
+	slot.vertCount = (int)bsp.verts.size();
+	slot.firstIndex = (int)firstIndex;
+	slot.indexCount = (int)bsp.indices.size();
+	slot.indicesReady = 0;
+
+	// Read straight out of the tree as the chunks go up, which is safe as long as the mesh stays
+	// in the scene; Remove drops anything still queued for it
+	UploadJob vertJob = { &slot, &bsp, false, 0, bsp.verts.size() };
+	UploadJob indexJob = { &slot, &bsp, true, 0, bsp.indices.size() };
+
+	if (vertJob.count && indexJob.count)
+	{
+		uploads.push_back(vertJob);
+		uploads.push_back(indexJob);
+	}
+
+	// Light is a byte a vert, not worth queueing
+	SetLight(slot, bsp.vertLight);
+}
+
+void MeshBuffer::Upload()
+{
+	TRACE_SCOPE("MeshBuffer::Upload");
+	MemScope mem(MEM_GL);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	frameBytes = 0;
+
+	if (uploads.empty())
+	{
+		return;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+
+	while (!uploads.empty() && frameBytes < uploadBudget)
+	{
+		UploadJob& job = uploads.front();
+		size_t elementSize = job.indices ? sizeof(unsigned int) : sizeof(float) * 3;
+		size_t count = std::min(job.count - job.done, std::min((size_t)UPLOAD_CHUNK, uploadBudget - frameBytes) / elementSize);
+		size_t bytes = count * elementSize;
+
+		if (!count)
+		{
+			break;
+		}
+
+		// Invalidating orphans the last chunk's storage rather than waiting on its copy to finish
+		void* staging = glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+		if (!staging)
+		{
+			break;
+		}
+
+		if (job.indices)
+		{
+			// Indices stay local to the mesh, the base vertex moves them to its slot at draw time
+			memcpy(staging, &job.bsp->indices[job.done], bytes);
+		}
+		else
+		{
+			// BSP verts are in 16.16 fixed point format, so we need to convert them here to the correct format for OpenGL
+			BspTree::ToFloat(&job.bsp->verts[job.done], count, (float*)staging);
+		}
+
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+		size_t first = job.indices ? job.slot->firstIndex : job.slot->baseVertex;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, job.indices ? EBO : VBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, (first + job.done) * elementSize, bytes);
+
+		job.done += count;
+		frameBytes += bytes;
+
+		if (job.indices)
+		{
+			job.slot->indicesReady = (int)job.done;
+		}
+
+		if (job.done == job.count)
+		{
+			uploads.pop_front();
+		}
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	uploadedBytes += frameBytes;
+	uploadSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+size_t MeshBuffer::PendingBytes() const
+{
+	size_t bytes = 0;
+
+	for (size_t i = 0; i < uploads.size(); i++)
+	{
+		bytes += (uploads[i].count - uploads[i].done) * (uploads[i].indices ? sizeof(unsigned int) : sizeof(float) * 3);
+	}
+
+	return bytes;
+}
+
+void MeshBuffer::Remove(const MeshSlot& slot)
+{
+	for (size_t i = 0; i < uploads.size(); )
+	{
+		if (uploads[i].slot == &slot)
+		{
+			uploads.erase(uploads.begin() + i);
+			continue;
+		}
+
+		i++;
+	}
+
+	verts.Free(slot.baseVertex, slot.vertCount);
+	indices.Free(slot.firstIndex, slot.indexCount);
+}
+
+void MeshBuffer::SetLight(const MeshSlot& slot, const std::vector<unsigned char>& light)
+{
+	if ((int)light.size() != slot.vertCount)
+	{
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, slot.baseVertex, light.size(), light.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
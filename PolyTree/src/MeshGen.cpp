@@ -0,0 +1,565 @@
+#include "MeshGen.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "MemTrack.h"
+#include "Parallel.h"
+
+#define CHUNK_TRIS 65536
+#define CHUNKS_PER_THREAD 2
+
+// Everything has to fit in 16.16 once it's loaded, with room for slivers and quads poking out
+// past the edge
+#define MAX_EXTENT 16000.0f
+
+#define PLANE_COUNT 6
+
+static const char* kindNames[MESHGEN_KIND_COUNT] = { "soup", "grid", "interior", "coplanar", "slivers" };
+
+// Corners and outward facing triangles of a box, same layout as the sample cube
+static const int boxCorners[8][3] = { { -1, -1, -1 }, { 1, -1, -1 }, { 1, 1, -1 }, { -1, 1, -1 }, { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } };
+static const int boxTris[12][3] = { { 0, 2, 1 }, { 0, 3, 2 }, { 4, 5, 6 }, { 4, 6, 7 }, { 0, 1, 5 }, { 0, 5, 4 }, { 3, 7, 6 }, { 3, 6, 2 }, { 0, 4, 7 }, { 0, 7, 3 }, { 1, 2, 6 }, { 1, 6, 5 } };
+
+static uint32_t ChunkSeed(uint32_t seed, long long chunk)
+{
+	// splitmix64, so neighbouring chunks don't get related sequences
+	uint64_t z = seed + (uint64_t)(chunk + 1) * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return (uint32_t)(z ^ (z >> 31));
+}
+
+static float Random(uint32_t& rng)
+{
+	rng = rng * 1664525u + 1013904223u;
+	return (rng >> 8) / 16777216.0f;
+}
+
+static float Range(uint32_t& rng, float lo, float hi)
+{
+	return lo + (hi - lo) * Random(rng);
+}
+
+static void Normalize(float* v)
+{
+	float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+	if (len > 0.0f)
+	{
+		v[0] /= len;
+		v[1] /= len;
+		v[2] /= len;
+	}
+}
+
+static void Cross(const float* a, const float* b, float* out)
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void AddVert(std::vector<float>& verts, float x, float y, float z)
+{
+	verts.push_back(x);
+	verts.push_back(y);
+	verts.push_back(z);
+}
+
+static void AddTri(std::vector<long long>& tris, long long a, long long b, long long c)
+{
+	tris.push_back(a);
+	tris.push_back(b);
+	tris.push_back(c);
+}
+
+static char* WriteInt(char* p, long long v)
+{
+	char digits[24];
+	int n = 0;
+
+	if (v < 0)
+	{
+		*p++ = '-';
+		v = -v;
+	}
+
+	do
+	{
+		digits[n++] = (char)('0' + v % 10);
+		v /= 10;
+	}
+	while (v);
+
+	while (n)
+	{
+		*p++ = digits[--n];
+	}
+
+	return p;
+}
+
+// Four decimal places, which is as close as 16.16 gets anyway
+static char* WriteFloat(char* p, float f)
+{
+	long long v = llroundf(f * 10000.0f);
+
+	if (v < 0)
+	{
+		*p++ = '-';
+		v = -v;
+	}
+
+	p = WriteInt(p, v / 10000);
+	*p++ = '.';
+
+	int frac = (int)(v % 10000);
+	p[0] = (char)('0' + frac / 1000);
+	p[1] = (char)('0' + frac / 100 % 10);
+	p[2] = (char)('0' + frac / 10 % 10);
+	p[3] = (char)('0' + frac % 10);
+	return p + 4;
+}
+
+MeshGen::MeshGen()
+{
+	kind = MESHGEN_SOUP;
+	triCount = 10000;
+	seed = 1;
+	size = 0.0f;
+	threadCount = HardwareThreads();
+
+	vertsMade = trisMade = 0;
+	bytesWritten = 0;
+	seconds = 0.0;
+}
+
+const char* MeshGen::KindName(MeshGenKind kind)
+{
+	return kind >= 0 && kind < MESHGEN_KIND_COUNT ? kindNames[kind] : "unknown";
+}
+
+bool MeshGen::FindKind(const char* name, MeshGenKind& kind)
+{
+	for (int i = 0; i < MESHGEN_KIND_COUNT; i++)
+	{
+		if (!strcmp(name, kindNames[i]))
+		{
+			kind = (MeshGenKind)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+float MeshGen::Extent() const
+{
+	float extent = size;
+
+	if (extent <= 0.0f)
+	{
+		// Roughly the same density whatever the count
+		switch (kind)
+		{
+		case MESHGEN_GRID:
+			extent = GridSide() * 0.5f;
+			break;
+		case MESHGEN_INTERIOR:
+			extent = cbrtf(triCount / 12.0f) * 2.0f + 4.0f;
+			break;
+		case MESHGEN_COPLANAR:
+			extent = sqrtf(triCount / (2.0f * PLANE_COUNT)) + 2.0f;
+			break;
+		default:
+			extent = cbrtf((float)triCount) + 2.0f;
+			break;
+		}
+	}
+
+	return extent < MAX_EXTENT ? extent : MAX_EXTENT;
+}
+
+int MeshGen::GridSide() const
+{
+	int side = (int)sqrt(triCount * 0.5);
+	return side > 1 ? side : 1;
+}
+
+long long MeshGen::ChunkCount() const
+{
+	switch (kind)
+	{
+	case MESHGEN_GRID:
+	{
+		int rows = CHUNK_TRIS / (2 * GridSide());
+		rows = rows > 1 ? rows : 1;
+		return (GridSide() + rows - 1) / rows;
+	}
+	case MESHGEN_INTERIOR:
+		// The room itself goes in the first chunk alongside its boxes
+		return (triCount - 12) / 12 / (CHUNK_TRIS / 12) + 1;
+	default:
+		return (triCount + CHUNK_TRIS - 1) / CHUNK_TRIS;
+	}
+}
+
+void MeshGen::GenerateChunk(long long chunk, Chunk& out) const
+{
+	uint32_t rng = ChunkSeed(seed, chunk);
+
+	out.verts.clear();
+	out.tris.clear();
+
+	switch (kind)
+	{
+	case MESHGEN_SOUP:
+	{
+		long long first = chunk * CHUNK_TRIS;
+		Soup(std::min<long long>(CHUNK_TRIS, triCount - first), rng, out);
+		break;
+	}
+	case MESHGEN_GRID:
+		Grid(chunk, out);
+		break;
+	case MESHGEN_INTERIOR:
+	{
+		long long boxes = (triCount - 12) / 12, first = chunk * (CHUNK_TRIS / 12);
+		Interior(first, std::min<long long>(CHUNK_TRIS / 12, boxes - first), rng, out);
+		break;
+	}
+	case MESHGEN_COPLANAR:
+	{
+		long long quads = triCount / 2, first = chunk * (CHUNK_TRIS / 2);
+		Coplanar(first, std::min<long long>(CHUNK_TRIS / 2, quads - first), rng, out);
+		break;
+	}
+	default:
+	{
+		long long first = chunk * CHUNK_TRIS;
+		Slivers(std::min<long long>(CHUNK_TRIS, triCount - first), rng, out);
+		break;
+	}
+	}
+}
+
+void MeshGen::Soup(long long count, uint32_t& rng, Chunk& out) const
+{
+	float extent = Extent();
+
+	for (long long i = 0; i < count; i++)
+	{
+		float cx = Range(rng, -extent, extent), cy = Range(rng, -extent, extent), cz = Range(rng, -extent, extent);
+
+		for (int k = 0; k < 3; k++)
+		{
+			AddVert(out.verts, cx + Range(rng, -1.0f, 1.0f), cy + Range(rng, -1.0f, 1.0f), cz + Range(rng, -1.0f, 1.0f));
+		}
+
+		AddTri(out.tris, i * 3, i * 3 + 1, i * 3 + 2);
+	}
+}
+
+void MeshGen::Grid(long long chunk, Chunk& out) const
+{
+	int side = GridSide();
+	int rows = CHUNK_TRIS / (2 * side);
+	rows = rows > 1 ? rows : 1;
+
+	int z0 = (int)(chunk * rows), z1 = std::min(side, z0 + rows);
+	float spacing = Extent() * 2.0f / side;
+
+	// Each chunk adds the vert rows below its quads, the first chunk the top row too, so the
+	// quads along the seam reach back into the last chunk's verts
+	int firstRow = chunk ? z0 + 1 : 0;
+
+	for (int z = firstRow; z <= z1; z++)
+	{
+		for (int x = 0; x <= side; x++)
+		{
+			float height = (sinf(x * 0.3f) * cosf(z * 0.2f) + sinf((x + z) * 0.05f) * 2.0f) * spacing;
+			AddVert(out.verts, (x - side * 0.5f) * spacing, height, (z - side * 0.5f) * spacing);
+		}
+	}
+
+	for (int z = z0; z < z1; z++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			long long a = (long long)(z - firstRow) * (side + 1) + x, b = a + 1, c = a + side + 1, d = c + 1;
+
+			AddTri(out.tris, a, c, b);
+			AddTri(out.tris, b, c, d);
+		}
+	}
+}
+
+void MeshGen::Interior(long long first, long long count, uint32_t& rng, Chunk& out) const
+{
+	float extent = Extent();
+	float height = std::max(extent * 0.25f, 4.0f);
+
+	if (first == 0)
+	{
+		// Walls, floor and ceiling, facing in
+		for (int i = 0; i < 8; i++)
+		{
+			AddVert(out.verts, boxCorners[i][0] * extent, boxCorners[i][1] * height, boxCorners[i][2] * extent);
+		}
+
+		for (int i = 0; i < 12; i++)
+		{
+			AddTri(out.tris, boxTris[i][0], boxTris[i][2], boxTris[i][1]);
+		}
+	}
+
+	for (long long i = 0; i < count; i++)
+	{
+		long long base = (long long)out.verts.size() / 3;
+		float half[3] = { Range(rng, 0.3f, 2.0f), Range(rng, 0.3f, 2.0f), Range(rng, 0.3f, 2.0f) };
+		float cx = Range(rng, -extent + half[0], extent - half[0]), cz = Range(rng, -extent + half[2], extent - half[2]);
+
+		// Mostly sat on the floor, some stacked or hanging in mid air
+		float cy = Random(rng) < 0.6f ? -height + half[1] : Range(rng, -height + half[1], height - half[1]);
+
+		// Half are turned about the vertical, so not everything lines up with the walls
+		float angle = Random(rng) < 0.5f ? 0.0f : Range(rng, 0.0f, 3.14159265f);
+		float c = cosf(angle), s = sinf(angle);
+
+		for (int k = 0; k < 8; k++)
+		{
+			float x = boxCorners[k][0] * half[0], z = boxCorners[k][2] * half[2];
+			AddVert(out.verts, cx + x * c - z * s, cy + boxCorners[k][1] * half[1], cz + x * s + z * c);
+		}
+
+		for (int k = 0; k < 12; k++)
+		{
+			AddTri(out.tris, base + boxTris[k][0], base + boxTris[k][1], base + boxTris[k][2]);
+		}
+	}
+}
+
+void MeshGen::Coplanar(long long first, long long count, uint32_t& rng, Chunk& out) const
+{
+	float extent = Extent();
+
+	// Three floors, two walls and a diagonal, each given as a point and two axes in the plane
+	const float r = 0.70710678f;
+	const float planes[PLANE_COUNT][9] =
+	{
+		{ 0.0f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f },
+		{ 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f },
+		{ 0.0f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f },
+		{ -0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f },
+		{ 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f },
+		{ 0.0f, 0.0f, 0.0f, r, 0.0f, -r, 0.0f, 1.0f, 0.0f }
+	};
+
+	for (long long i = 0; i < count; i++)
+	{
+		const float* p = planes[(first + i) % PLANE_COUNT];
+		long long base = (long long)out.verts.size() / 3;
+		float u = Range(rng, -extent, extent), v = Range(rng, -extent, extent);
+		float half = Range(rng, 0.25f, 1.0f), angle = Range(rng, 0.0f, 3.14159265f);
+		float c = cosf(angle) * half, s = sinf(angle) * half;
+		float corners[4][2] = { { -c + s, -s - c }, { c + s, s - c }, { c - s, s + c }, { -c - s, -s + c } };
+
+		for (int k = 0; k < 4; k++)
+		{
+			float cu = u + corners[k][0], cv = v + corners[k][1];
+			AddVert(out.verts,
+				p[0] * extent + p[3] * cu + p[6] * cv,
+				p[1] * extent + p[4] * cu + p[7] * cv,
+				p[2] * extent + p[5] * cu + p[8] * cv);
+		}
+
+		// Some face the other way, so nodes get triangles on both sides of their plane
+		if (Random(rng) < 0.5f)
+		{
+			AddTri(out.tris, base, base + 1, base + 2);
+			AddTri(out.tris, base, base + 2, base + 3);
+		}
+		else
+		{
+			AddTri(out.tris, base, base + 2, base + 1);
+			AddTri(out.tris, base, base + 3, base + 2);
+		}
+	}
+}
+
+void MeshGen::Slivers(long long count, uint32_t& rng, Chunk& out) const
+{
+	float extent = Extent();
+
+	for (long long i = 0; i < count; i++)
+	{
+		float center[3] = { Range(rng, -extent, extent), Range(rng, -extent, extent), Range(rng, -extent, extent) };
+		float dir[3] = { Range(rng, -1.0f, 1.0f), Range(rng, -1.0f, 1.0f), Range(rng, -1.0f, 1.0f) };
+		float other[3] = { Range(rng, -1.0f, 1.0f), Range(rng, -1.0f, 1.0f), Range(rng, -1.0f, 1.0f) };
+		float side[3];
+
+		Normalize(dir);
+		Cross(dir, other, side);
+		Normalize(side);
+
+		// A few hundred times longer than they are wide, but short enough that each only crosses
+		// its neighbours rather than the whole space
+		float length = Range(rng, 2.0f, 8.0f), width = length * Range(rng, 0.001f, 0.01f);
+
+		AddVert(out.verts, center[0] - dir[0] * length, center[1] - dir[1] * length, center[2] - dir[2] * length);
+		AddVert(out.verts, center[0] + dir[0] * length, center[1] + dir[1] * length, center[2] + dir[2] * length);
+		AddVert(out.verts, center[0] + side[0] * width, center[1] + side[1] * width, center[2] + side[2] * width);
+		AddTri(out.tris, i * 3, i * 3 + 1, i * 3 + 2);
+	}
+}
+
+void MeshGen::FormatChunk(Chunk& chunk) const
+{
+	size_t vertCount = chunk.verts.size() / 3;
+
+	// Worst case line lengths, trimmed once we know where it ended
+	chunk.text.resize(vertCount * 3 * 24 + chunk.tris.size() / 3 * 70);
+
+	char* start = &chunk.text[0];
+	char* p = start;
+
+	for (size_t i = 0; i < vertCount; i++)
+	{
+		*p++ = 'v';
+
+		for (int k = 0; k < 3; k++)
+		{
+			*p++ = ' ';
+			p = WriteFloat(p, chunk.verts[i * 3 + k]);
+		}
+
+		*p++ = '\n';
+	}
+
+	for (size_t i = 0; i < chunk.tris.size(); i += 3)
+	{
+		*p++ = 'f';
+
+		for (int k = 0; k < 3; k++)
+		{
+			*p++ = ' ';
+			p = WriteInt(p, chunk.base + chunk.tris[i + k] + 1);
+		}
+
+		*p++ = '\n';
+	}
+
+	chunk.text.resize(p - start);
+}
+
+void MeshGen::Generate(Obj& out)
+{
+	MemScope mem(MEM_LOADER);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	long long chunkCount = ChunkCount();
+	int batchSize = (threadCount > 1 ? threadCount : 1) * CHUNKS_PER_THREAD;
+	std::vector<Chunk> chunks(batchSize);
+
+	verts.clear();
+	indices.clear();
+
+	for (long long batch = 0; batch < chunkCount; batch += batchSize)
+	{
+		int count = (int)std::min<long long>(batchSize, chunkCount - batch);
+
+		ParallelFor(count, threadCount, [&](int i) { GenerateChunk(batch + i, chunks[i]); });
+
+		for (int i = 0; i < count; i++)
+		{
+			const Chunk& chunk = chunks[i];
+			long long base = (long long)verts.size();
+
+			for (size_t v = 0; v < chunk.verts.size(); v += 3)
+			{
+				ObjVertex vert;
+				vert.x = (int32_t)(chunk.verts[v] * 65536.0f);
+				vert.y = (int32_t)(chunk.verts[v + 1] * 65536.0f);
+				vert.z = (int32_t)(chunk.verts[v + 2] * 65536.0f);
+				verts.push_back(vert);
+			}
+
+			for (size_t t = 0; t < chunk.tris.size(); t++)
+			{
+				indices.push_back((ObjIndex)(base + chunk.tris[t]));
+			}
+		}
+	}
+
+	memset(&out, 0, sizeof(out));
+	out.verts = verts.data();
+	out.indices = indices.data();
+	out.vertCount = (int)verts.size();
+	out.indexCount = (int)indices.size();
+	out.faceCount = (int)indices.size() / 3;
+
+	vertsMade = (long long)verts.size();
+	trisMade = (long long)indices.size() / 3;
+	bytesWritten = 0;
+	seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void MeshGen::Clear()
+{
+	std::vector<ObjVertex>().swap(verts);
+	std::vector<ObjIndex>().swap(indices);
+}
+
+bool MeshGen::Write(const char* filename)
+{
+	MemScope mem(MEM_LOADER);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	FILE* f = fopen(filename, "wb");
+	long long chunkCount = ChunkCount();
+	int batchSize = (threadCount > 1 ? threadCount : 1) * CHUNKS_PER_THREAD;
+	std::vector<Chunk> chunks(batchSize);
+	bool ok = f != NULL;
+
+	vertsMade = trisMade = 0;
+	bytesWritten = 0;
+
+	if (ok)
+	{
+		fprintf(f, "# polytree-gen %s, %lld triangles, seed %u\n", KindName(kind), triCount, seed);
+	}
+
+	// Chunks are generated in parallel, numbered once the batch's vert counts are known, turned
+	// into text in parallel, then written in order
+	for (long long batch = 0; ok && batch < chunkCount; batch += batchSize)
+	{
+		int count = (int)std::min<long long>(batchSize, chunkCount - batch);
+
+		ParallelFor(count, threadCount, [&](int i) { GenerateChunk(batch + i, chunks[i]); });
+
+		for (int i = 0; i < count; i++)
+		{
+			chunks[i].base = vertsMade;
+			vertsMade += chunks[i].verts.size() / 3;
+			trisMade += chunks[i].tris.size() / 3;
+		}
+
+		ParallelFor(count, threadCount, [&](int i) { FormatChunk(chunks[i]); });
+
+		for (int i = 0; ok && i < count; i++)
+		{
+			ok = fwrite(chunks[i].text.data(), 1, chunks[i].text.size(), f) == chunks[i].text.size();
+			bytesWritten += chunks[i].text.size();
+		}
+	}
+
+	if (f && fclose(f) != 0)
+	{
+		ok = false;
+	}
+
+	seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	return ok;
+}
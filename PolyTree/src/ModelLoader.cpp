@@ -0,0 +1,114 @@
+#include "ModelLoader.h"
+
+#include "Trace.h"
+
+ModelLoader::ModelLoader() : finished(false)
+{
+	running = false;
+	succeeded = false;
+	buildVis = false;
+	obj = NULL;
+	baking = NULL;
+}
+
+ModelLoader::~ModelLoader()
+{
+	Stop();
+}
+
+void ModelLoader::Stop()
+{
+	Cancel();
+	Join();
+	delete obj;
+	obj = NULL;
+	baking = NULL;
+}
+
+void ModelLoader::Start(const char* filePath, const char* displayName, bool vis)
+{
+	if (running)
+	{
+		return;
+	}
+
+	path = filePath;
+	name = displayName;
+	buildVis = vis;
+	progress.Reset();
+	finished = false;
+	succeeded = false;
+	running = true;
+	obj = new AtariObj();
+
+	worker = std::thread([this]()
+	{
+		Trace::SetThreadName("Loader");
+		succeeded = obj->Load(&path[0], buildVis, &progress);
+		finished.store(true, std::memory_order_release);
+	});
+}
+
+void ModelLoader::Bake(AtariObj* target, const char* displayName)
+{
+	if (running)
+	{
+		return;
+	}
+
+	name = displayName;
+	progress.Reset();
+	finished = false;
+	succeeded = false;
+	running = true;
+	baking = target;
+
+	worker = std::thread([this]()
+	{
+		Trace::SetThreadName("Loader");
+		succeeded = baking->BakeLighting(&progress);
+		finished.store(true, std::memory_order_release);
+	});
+}
+
+AtariObj* ModelLoader::Poll()
+{
+	if (!running || !finished.load(std::memory_order_acquire))
+	{
+		return NULL;
+	}
+
+	Join();
+
+	if (baking)
+	{
+		if (succeeded)
+		{
+			baking->ApplyLighting();
+		}
+
+		baking = NULL;
+		return NULL;
+	}
+
+	AtariObj* result = obj;
+	obj = NULL;
+
+	if (!succeeded)
+	{
+		delete result;
+		result = NULL;
+	}
+
+	return result;
+}
+
+void ModelLoader::Join()
+{
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+
+	running = false;
+}
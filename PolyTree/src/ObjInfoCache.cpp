@@ -0,0 +1,533 @@
+#include "ObjInfoCache.h"
+
+#include <glad/glad.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "ObjLineReader.h"
+#include "Parallel.h"
+
+#define CACHE_MAGIC 0x50544F49	// "PTOI"
+#define CACHE_VERSION 1
+
+#define SCAN_BUFFER (1 << 20)
+#define MAX_WORKERS 4
+
+// How stale a file's stats can get before Get looks at it again, so edits show up while browsing
+#define RESTAT_SECONDS 2
+
+// Thumbnails need every vert in memory, so really big files only get counts and bounds
+#define THUMB_MAX_BYTES (128LL << 20)
+#define THUMB_MAX_FACE_INTS (256 * 1024)
+#define THUMB_ANGLE 30.0f
+
+struct ScanState
+{
+	ObjInfo* info;
+	bool keepVerts;
+	std::vector<float> verts;
+
+	// Each face as its vert count followed by zero based indices. Once it fills up, every other
+	// face gets dropped and only every faceStride'th face is kept from then on.
+	std::vector<int> faces;
+	int faceStride;
+};
+
+static bool FileStats(const char* path, int64_t& mtime, int64_t& size)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+
+	if (_stat64(path, &st) != 0)
+#else
+	struct stat st;
+
+	if (stat(path, &st) != 0)
+#endif
+	{
+		return false;
+	}
+
+	mtime = (int64_t)st.st_mtime;
+	size = (int64_t)st.st_size;
+	return true;
+}
+
+static void ThinFaces(ScanState& s)
+{
+	std::vector<int> kept;
+	bool keep = true;
+
+	for (size_t i = 0; i < s.faces.size(); i += s.faces[i] + 1)
+	{
+		if (keep)
+		{
+			kept.insert(kept.end(), s.faces.begin() + i, s.faces.begin() + i + s.faces[i] + 1);
+		}
+
+		keep = !keep;
+	}
+
+	s.faces.swap(kept);
+	s.faceStride *= 2;
+}
+
+static void ParseLine(char* line, ScanState& s)
+{
+	ObjInfo& info = *s.info;
+
+	while (*line == ' ' || *line == '\t')
+	{
+		line++;
+	}
+
+	if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+	{
+		char* p = line + 2;
+		float v[3];
+
+		for (int i = 0; i < 3; i++)
+		{
+			v[i] = strtof(p, &p);
+			info.boundsMin[i] = fminf(info.boundsMin[i], v[i]);
+			info.boundsMax[i] = fmaxf(info.boundsMax[i], v[i]);
+		}
+
+		if (s.keepVerts)
+		{
+			s.verts.insert(s.verts.end(), v, v + 3);
+		}
+
+		info.vertCount++;
+	}
+	else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+	{
+		bool keepFace = s.keepVerts && info.faceCount % s.faceStride == 0;
+		size_t countAt = s.faces.size();
+		int count = 0;
+		char* p = line + 2;
+		long long index;
+
+		if (keepFace)
+		{
+			s.faces.push_back(0);
+		}
+
+		// Only the position index matters
+		while (ObjLineReader::FaceIndex(p, index))
+		{
+			if (keepFace)
+			{
+				s.faces.push_back(index < 0 ? info.vertCount + (int)index : (int)index - 1);
+			}
+
+			count++;
+		}
+
+		if (keepFace)
+		{
+			s.faces[countAt] = count;
+
+			if (s.faces.size() > THUMB_MAX_FACE_INTS)
+			{
+				ThinFaces(s);
+			}
+		}
+
+		info.faceCount++;
+		info.triCount += count >= 3 ? count - 2 : 0;
+	}
+}
+
+static void SetPixel(ObjInfo& info, int x, int y)
+{
+	if (x >= 0 && y >= 0 && x < OBJ_THUMB_SIZE && y < OBJ_THUMB_SIZE)
+	{
+		info.thumb[(y * OBJ_THUMB_SIZE + x) >> 3] |= 1 << (x & 7);
+	}
+}
+
+static void DrawLine(ObjInfo& info, int x0, int y0, int x1, int y1)
+{
+	int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+	int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy;
+
+	for (;;)
+	{
+		SetPixel(info, x0, y0);
+
+		if (x0 == x1 && y0 == y1)
+		{
+			break;
+		}
+
+		int e2 = err * 2;
+
+		if (e2 >= dy)
+		{
+			err += dy;
+			x0 += sx;
+		}
+
+		if (e2 <= dx)
+		{
+			err += dx;
+			y0 += sy;
+		}
+	}
+}
+
+// Wireframe from the same angle the viewer starts at, fitted to the thumbnail
+static void DrawThumb(ScanState& s)
+{
+	ObjInfo& info = *s.info;
+	int vertCount = (int)s.verts.size() / 3;
+	float c = cosf(THUMB_ANGLE * 3.14159265f / 180.0f), sn = sinf(THUMB_ANGLE * 3.14159265f / 180.0f);
+	std::vector<float> projected(vertCount * 2);
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+	if (!vertCount || s.faces.empty())
+	{
+		return;
+	}
+
+	for (int i = 0; i < vertCount; i++)
+	{
+		const float* v = &s.verts[i * 3];
+		float x = v[0], y = v[1] * c - v[2] * sn;
+
+		projected[i * 2] = x;
+		projected[i * 2 + 1] = y;
+		minX = fminf(minX, x);
+		maxX = fmaxf(maxX, x);
+		minY = fminf(minY, y);
+		maxY = fmaxf(maxY, y);
+	}
+
+	float scale = (OBJ_THUMB_SIZE - 4) / fmaxf(fmaxf(maxX - minX, maxY - minY), 1e-6f);
+	float offsetX = (OBJ_THUMB_SIZE - (maxX - minX) * scale) * 0.5f;
+	float offsetY = (OBJ_THUMB_SIZE - (maxY - minY) * scale) * 0.5f;
+
+	for (size_t i = 0; i < s.faces.size(); i += s.faces[i] + 1)
+	{
+		int count = s.faces[i];
+		const int* face = &s.faces[i + 1];
+
+		for (int k = 0; k < count; k++)
+		{
+			int a = face[k], b = face[(k + 1) % count];
+
+			if (a < 0 || b < 0 || a >= vertCount || b >= vertCount)
+			{
+				continue;
+			}
+
+			// Flipped, as the rows go top to bottom
+			DrawLine(info,
+				(int)(offsetX + (projected[a * 2] - minX) * scale), (int)(OBJ_THUMB_SIZE - 1 - offsetY - (projected[a * 2 + 1] - minY) * scale),
+				(int)(offsetX + (projected[b * 2] - minX) * scale), (int)(OBJ_THUMB_SIZE - 1 - offsetY - (projected[b * 2 + 1] - minY) * scale));
+		}
+	}
+
+	info.hasThumb = true;
+}
+
+bool ObjInfoCache::Scan(const char* path, ObjInfo& info)
+{
+	int64_t mtime, size;
+	ScanState s;
+	FILE* f;
+
+	if (!FileStats(path, mtime, size) || !(f = fopen(path, "rb")))
+	{
+		return false;
+	}
+
+	memset(&info, 0, sizeof(info));
+
+	for (int i = 0; i < 3; i++)
+	{
+		info.boundsMin[i] = FLT_MAX;
+		info.boundsMax[i] = -FLT_MAX;
+	}
+
+	s.info = &info;
+	s.keepVerts = size <= THUMB_MAX_BYTES;
+	s.faceStride = 1;
+
+	ObjLineReader reader(f, SCAN_BUFFER);
+	char* line;
+
+	while ((line = reader.Next()) != NULL)
+	{
+		ParseLine(line, s);
+	}
+
+	fclose(f);
+
+	if (!info.vertCount)
+	{
+		memset(info.boundsMin, 0, sizeof(info.boundsMin));
+		memset(info.boundsMax, 0, sizeof(info.boundsMax));
+	}
+
+	DrawThumb(s);
+
+	return true;
+}
+
+ObjInfoCache::ObjInfoCache(const char* path)
+{
+	cachePath = path;
+	stopping = false;
+	dirty = false;
+
+	Load();
+
+	int threadCount = HardwareThreads() < MAX_WORKERS ? HardwareThreads() : MAX_WORKERS;
+
+	for (int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&ObjInfoCache::Work, this));
+	}
+}
+
+ObjInfoCache::~ObjInfoCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+
+	if (dirty)
+	{
+		Save();
+	}
+
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (it->second.texture)
+		{
+			glDeleteTextures(1, &it->second.texture);
+		}
+	}
+
+	if (!staleTextures.empty())
+	{
+		glDeleteTextures((GLsizei)staleTextures.size(), staleTextures.data());
+	}
+}
+
+void ObjInfoCache::Work()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;)
+	{
+		wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+
+		if (stopping)
+		{
+			return;
+		}
+
+		std::string path = queue.front();
+		ObjInfo info;
+
+		queue.pop_front();
+		lock.unlock();
+
+		bool ok = Scan(path.c_str(), info);
+
+		lock.lock();
+
+		Entry& entry = entries[path];
+		entry.info = info;
+		entry.state = ok ? STATE_READY : STATE_FAILED;
+		dirty = true;
+	}
+}
+
+const ObjInfo* ObjInfoCache::Get(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<std::string, Entry>::iterator it = entries.find(path);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	if (it == entries.end() || now - it->second.checkedAt > std::chrono::seconds(RESTAT_SECONDS))
+	{
+		int64_t mtime = 0, size = 0;
+		bool exists = FileStats(path.c_str(), mtime, size);
+		Entry& entry = entries[path];
+
+		if (it == entries.end() || entry.mtime != mtime || entry.size != size)
+		{
+			entry.mtime = mtime;
+			entry.size = size;
+
+			if (entry.texture)
+			{
+				staleTextures.push_back(entry.texture);
+				entry.texture = 0;
+			}
+
+			if (exists)
+			{
+				entry.state = STATE_QUEUED;
+				queue.push_back(path);
+				wake.notify_one();
+			}
+			else
+			{
+				entry.state = STATE_FAILED;
+			}
+		}
+
+		entry.checkedAt = now;
+		return entry.state == STATE_READY ? &entry.info : NULL;
+	}
+
+	return it->second.state == STATE_READY ? &it->second.info : NULL;
+}
+
+unsigned int ObjInfoCache::Thumbnail(const std::string& path)
+{
+	const ObjInfo* info = Get(path);
+
+	if (!info || !info->hasThumb)
+	{
+		return 0;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	Entry& entry = entries[path];
+
+	if (!staleTextures.empty())
+	{
+		glDeleteTextures((GLsizei)staleTextures.size(), staleTextures.data());
+		staleTextures.clear();
+	}
+
+	if (!entry.texture)
+	{
+		std::vector<unsigned int> pixels(OBJ_THUMB_SIZE * OBJ_THUMB_SIZE);
+
+		for (int i = 0; i < OBJ_THUMB_SIZE * OBJ_THUMB_SIZE; i++)
+		{
+			pixels[i] = (info->thumb[i >> 3] >> (i & 7)) & 1 ? 0xFFFFFFFF : 0;
+		}
+
+		glGenTextures(1, &entry.texture);
+		glBindTexture(GL_TEXTURE_2D, entry.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, OBJ_THUMB_SIZE, OBJ_THUMB_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	return entry.texture;
+}
+
+int ObjInfoCache::Pending()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)queue.size();
+}
+
+void ObjInfoCache::Load()
+{
+	FILE* f = fopen(cachePath.c_str(), "rb");
+	uint32_t header[3];
+
+	if (!f)
+	{
+		return;
+	}
+
+	// magic, version, entry count, then each entry's path, mtime, size and info
+	if (fread(header, sizeof(uint32_t), 3, f) != 3 || header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION)
+	{
+		fclose(f);
+		return;
+	}
+
+	for (uint32_t i = 0; i < header[2]; i++)
+	{
+		uint32_t length;
+		std::string path;
+		Entry entry;
+
+		if (fread(&length, sizeof(length), 1, f) != 1 || length > 4096)
+		{
+			break;
+		}
+
+		path.resize(length);
+
+		if (fread(&path[0], 1, length, f) != length || fread(&entry.mtime, sizeof(entry.mtime), 1, f) != 1 ||
+			fread(&entry.size, sizeof(entry.size), 1, f) != 1 || fread(&entry.info, sizeof(entry.info), 1, f) != 1)
+		{
+			break;
+		}
+
+		entry.state = STATE_READY;
+		entry.checkedAt = std::chrono::steady_clock::time_point();
+		entry.texture = 0;
+		entries[path] = entry;
+	}
+
+	fclose(f);
+}
+
+bool ObjInfoCache::Save()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	FILE* f = fopen(cachePath.c_str(), "wb");
+	uint32_t header[3] = { CACHE_MAGIC, CACHE_VERSION, 0 };
+
+	if (!f)
+	{
+		return false;
+	}
+
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		header[2] += it->second.state == STATE_READY;
+	}
+
+	fwrite(header, sizeof(uint32_t), 3, f);
+
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		const Entry& entry = it->second;
+		uint32_t length = (uint32_t)it->first.size();
+
+		if (entry.state != STATE_READY)
+		{
+			continue;
+		}
+
+		fwrite(&length, sizeof(length), 1, f);
+		fwrite(it->first.data(), 1, length, f);
+		fwrite(&entry.mtime, sizeof(entry.mtime), 1, f);
+		fwrite(&entry.size, sizeof(entry.size), 1, f);
+		fwrite(&entry.info, sizeof(entry.info), 1, f);
+	}
+
+	dirty = false;
+	fclose(f);
+	return true;
+}
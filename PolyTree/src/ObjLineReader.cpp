@@ -0,0 +1,71 @@
+#include "ObjLineReader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+ObjLineReader::ObjLineReader(FILE* file, size_t bufferSize) : f(file), buffer(bufferSize + 1), size(bufferSize)
+{
+	end = 0;
+	lineStart = 0;
+	bytesRead = 0;
+	atEnd = false;
+}
+
+char* ObjLineReader::Next()
+{
+	for (;;)
+	{
+		char* newline;
+
+		if (lineStart < end && (newline = (char*)memchr(&buffer[lineStart], '\n', end - lineStart)) != NULL)
+		{
+			char* line = &buffer[lineStart];
+
+			*newline = '\0';
+			lineStart = newline - buffer.data() + 1;
+			return line;
+		}
+
+		if (atEnd)
+		{
+			return NULL;
+		}
+
+		// A line longer than the whole buffer can't be anything we're after
+		size_t carry = end - lineStart < size ? end - lineStart : 0;
+		memmove(buffer.data(), &buffer[lineStart], carry);
+
+		size_t got = fread(&buffer[carry], 1, size - carry, f);
+
+		bytesRead += (long long)got;
+		end = carry + got;
+		lineStart = 0;
+
+		// The last line needn't end in a newline
+		if (!got)
+		{
+			atEnd = true;
+			buffer[end] = '\0';
+			lineStart = end;
+			return buffer.data();
+		}
+	}
+}
+
+bool ObjLineReader::FaceIndex(char*& p, long long& index)
+{
+	char* end;
+
+	index = strtoll(p, &end, 10);
+
+	if (end == p)
+	{
+		return false;
+	}
+
+	for (p = end; *p && *p != ' ' && *p != '\t' && *p != '\r'; p++)
+	{
+	}
+
+	return true;
+}
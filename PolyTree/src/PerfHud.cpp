@@ -0,0 +1,263 @@
+#include "PerfHud.h"
+
+#include <glad/glad.h>
+#include <imgui.h>
+
+#include <float.h>
+#include <algorithm>
+
+#include "MemTrack.h"
+
+#define HISTOGRAM_BUCKETS 32
+
+static const char* gpuTimerNames[PERF_GPU_TIMER_COUNT] = { "GPU scene", "GPU ImGui" };
+
+PerfSeries::PerfSeries()
+{
+	count = next = 0;
+}
+
+void PerfSeries::Add(float ms)
+{
+	values[next] = ms;
+	next = (next + 1) % PERF_HISTORY;
+	count = std::min(count + 1, PERF_HISTORY);
+}
+
+float PerfSeries::Percentile(float p) const
+{
+	if (!count)
+	{
+		return 0.0f;
+	}
+
+	float sorted[PERF_HISTORY];
+	int n = (int)(p * (count - 1) + 0.5f);
+
+	std::copy(values, values + count, sorted);
+	std::nth_element(sorted, sorted + n, sorted + count);
+	return sorted[n];
+}
+
+void PerfSeries::Ordered(std::vector<float>& out) const
+{
+	out.resize(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		out[i] = values[(next - count + i + PERF_HISTORY) % PERF_HISTORY];
+	}
+}
+
+PerfHud::PerfHud()
+{
+	open = true;
+	started = false;
+	frame = 0;
+	gpuSupported = false;
+	sceneDraws = imguiDraws = 0;
+	sceneTris = imguiTris = 0;
+
+	for (int i = 0; i < PERF_QUERY_FRAMES; i++)
+	{
+		for (int t = 0; t < PERF_GPU_TIMER_COUNT; t++)
+		{
+			queries[i][t] = 0;
+			pending[i][t] = false;
+		}
+	}
+}
+
+PerfHud::~PerfHud()
+{
+	if (queries[0][0])
+	{
+		glDeleteQueries(PERF_QUERY_FRAMES * PERF_GPU_TIMER_COUNT, &queries[0][0]);
+	}
+}
+
+void PerfHud::BeginFrame()
+{
+	Clock::time_point now = Clock::now();
+
+	if (started)
+	{
+		frameTime.Add(std::chrono::duration<float, std::milli>(now - frameStart).count());
+	}
+	else
+	{
+		// First frame, so there's a context to make the queries in
+		gpuSupported = GLAD_GL_VERSION_3_3 != 0;
+
+		if (gpuSupported)
+		{
+			glGenQueries(PERF_QUERY_FRAMES * PERF_GPU_TIMER_COUNT, &queries[0][0]);
+		}
+	}
+
+	frameStart = now;
+	started = true;
+	frame++;
+
+	// Whatever the GPU has finished since last time, oldest first so each series stays in order
+	for (int t = 0; t < PERF_GPU_TIMER_COUNT; t++)
+	{
+		for (int i = 1; i < PERF_QUERY_FRAMES; i++)
+		{
+			int slot = (frame + i) % PERF_QUERY_FRAMES;
+
+			if (pending[slot][t])
+			{
+				Collect(slot, (PerfGpuTimer)t, false);
+
+				if (pending[slot][t])
+				{
+					break;
+				}
+			}
+		}
+	}
+}
+
+void PerfHud::EndFrame()
+{
+	cpuTime.Add(std::chrono::duration<float, std::milli>(Clock::now() - frameStart).count());
+}
+
+void PerfHud::Collect(int slot, PerfGpuTimer timer, bool wait)
+{
+	unsigned int query = queries[slot][timer];
+
+	if (!wait)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (!available)
+		{
+			return;
+		}
+	}
+
+	GLuint64 ns = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+
+	gpuTime[timer].Add(ns / 1.0e6f);
+	pending[slot][timer] = false;
+}
+
+void PerfHud::BeginGpu(PerfGpuTimer timer)
+{
+	if (!gpuSupported)
+	{
+		return;
+	}
+
+	int slot = frame % PERF_QUERY_FRAMES;
+
+	// Only blocks if the GPU has fallen a whole ring of frames behind
+	if (pending[slot][timer])
+	{
+		Collect(slot, timer, true);
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, queries[slot][timer]);
+}
+
+void PerfHud::EndGpu(PerfGpuTimer timer)
+{
+	if (!gpuSupported)
+	{
+		return;
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	pending[frame % PERF_QUERY_FRAMES][timer] = true;
+}
+
+void PerfHud::SetCounts(int sceneDraws, long long sceneTris, int imguiDraws, long long imguiTris)
+{
+	this->sceneDraws = sceneDraws;
+	this->sceneTris = sceneTris;
+	this->imguiDraws = imguiDraws;
+	this->imguiTris = imguiTris;
+}
+
+void PerfHud::SeriesText(const char* label, const PerfSeries& series)
+{
+	ImGui::Text("%-12s %6.2f ms  p50 %6.2f  p99 %6.2f", label, series.Last(), series.Percentile(0.5f), series.Percentile(0.99f));
+}
+
+void PerfHud::Draw()
+{
+	if (!open)
+	{
+		return;
+	}
+
+	ImGui::SetNextWindowBgAlpha(0.75f);
+
+	if (!ImGui::Begin("Performance", &open, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing))
+	{
+		ImGui::End();
+		return;
+	}
+
+	float p50 = frameTime.Percentile(0.5f);
+	float p99 = frameTime.Percentile(0.99f);
+
+	ImGui::Text("%.1f fps at p50", p50 > 0.0f ? 1000.0f / p50 : 0.0f);
+	SeriesText("CPU frame", frameTime);
+	SeriesText("CPU work", cpuTime);
+
+	for (int t = 0; t < PERF_GPU_TIMER_COUNT; t++)
+	{
+		if (gpuSupported)
+		{
+			SeriesText(gpuTimerNames[t], gpuTime[t]);
+		}
+		else
+		{
+			ImGui::Text("%-12s needs GL 3.3 timer queries", gpuTimerNames[t]);
+		}
+	}
+
+	ImGui::Text("Scene: %i draws, %lld triangles", sceneDraws, sceneTris);
+	ImGui::Text("ImGui: %i draws, %lld triangles", imguiDraws, imguiTris);
+
+	// Rolling frame times, scaled so a few spikes don't flatten everything else
+	float top = std::max(p99 * 1.25f, 1.0f);
+
+	frameTime.Ordered(plot);
+	ImGui::PlotLines("##frames", plot.data(), (int)plot.size(), 0, "Frame time", 0.0f, top, ImVec2(300, 60));
+
+	float buckets[HISTOGRAM_BUCKETS] = {};
+
+	for (size_t i = 0; i < plot.size(); i++)
+	{
+		int b = (int)(plot[i] / top * HISTOGRAM_BUCKETS);
+		buckets[std::min(b, HISTOGRAM_BUCKETS - 1)]++;
+	}
+
+	ImGui::PlotHistogram("##histogram", buckets, HISTOGRAM_BUCKETS, 0, NULL, 0.0f, FLT_MAX, ImVec2(300, 60));
+	ImGui::Text("Frame times from 0 to %.1f ms", top);
+
+	if (ImGui::CollapsingHeader("Memory", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		ImGui::Text("%-18s %10s %10s", "", "MB", "Peak MB");
+
+		for (int i = 0; i < MEM_TAG_COUNT; i++)
+		{
+			MemStats stats = MemTrack::Stats((MemTag)i);
+
+			if (stats.peak)
+			{
+				ImGui::Text("%-18s %10.1f %10.1f", MemTrack::TagName((MemTag)i), stats.current / (1024.0 * 1024.0), stats.peak / (1024.0 * 1024.0));
+			}
+		}
+
+		ImGui::Text("%-18s %10.1f %10.1f", "Total", MemTrack::TotalCurrent() / (1024.0 * 1024.0), MemTrack::TotalPeak() / (1024.0 * 1024.0));
+	}
+
+	ImGui::End();
+}
@@ -0,0 +1,309 @@
+#include "Scene.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <math.h>
+#include <algorithm>
+
+#include "Trace.h"
+
+#define INSTANCE_ATTRIB 2
+
+Scene::Scene()
+{
+	selected = -1;
+	instancesDrawn = instancesCulled = drawCalls = 0;
+	trisSubmitted = 0;
+	instanceVBO = 0;
+	instanceCapacity = 0;
+	batchLit = false;
+}
+
+Scene::~Scene()
+{
+	Clear();
+
+	if (instanceVBO)
+	{
+		glDeleteBuffers(1, &instanceVBO);
+	}
+}
+
+int Scene::AddMesh(AtariObj* obj, const char* name)
+{
+	SceneMesh mesh;
+
+	buffer.Add(obj->bsp, obj->slot);
+
+	mesh.obj = obj;
+	mesh.name = name;
+	mesh.instances.push_back(glm::mat4(1.0f));
+	meshes.push_back(mesh);
+
+	selected = (int)meshes.size() - 1;
+
+	return selected;
+}
+
+void Scene::AddInstance(int mesh, const glm::mat4& transform)
+{
+	meshes[mesh].instances.push_back(transform);
+}
+
+void Scene::Clear()
+{
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		buffer.Remove(meshes[i].obj->slot);
+		delete meshes[i].obj;
+	}
+
+	meshes.clear();
+	selected = -1;
+}
+
+int Scene::InstanceCount() const
+{
+	int count = 0;
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		count += (int)meshes[i].instances.size();
+	}
+
+	return count;
+}
+
+void Scene::Stress(int mesh, int count)
+{
+	const BspTree& bsp = meshes[mesh].obj->bsp;
+	float spacing = 1.0f;
+
+	// Spaced by the mesh's own size so neighbours just about touch
+	if (!bsp.nodes.empty())
+	{
+		const BspBounds& b = bsp.nodes[0].bounds;
+		float dx = (b.max.x - b.min.x) / 65536.0f, dz = (b.max.z - b.min.z) / 65536.0f;
+
+		spacing = fmaxf(fmaxf(dx, dz) * 1.25f, 0.001f);
+	}
+
+	int side = (int)ceilf(sqrtf((float)count));
+	std::vector<glm::mat4>& instances = meshes[mesh].instances;
+
+	instances.clear();
+
+	for (int i = 0; i < count; i++)
+	{
+		float x = ((i % side) - (side - 1) * 0.5f) * spacing;
+		float z = ((i / side) - (side - 1) * 0.5f) * spacing;
+
+		instances.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z)));
+	}
+}
+
+void Scene::Render(const Shader& shader, int transformLoc, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection)
+{
+	TRACE_SCOPE("Scene::Render");
+	glm::mat4 viewProj = projection * view;
+
+	instancesDrawn = instancesCulled = drawCalls = 0;
+	trisSubmitted = 0;
+	visible.clear();
+
+	// Meshes still on their way up draw whatever triangles have made it so far
+	buffer.Upload();
+
+	// Lighting baked since the last frame goes up into the shared buffer
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		if (meshes[m].obj->lightChanged)
+		{
+			buffer.SetLight(meshes[m].obj->slot, meshes[m].obj->bsp.vertLight);
+			meshes[m].obj->lightChanged = false;
+		}
+	}
+
+	visibleStart.assign(meshes.size() + 1, 0);
+
+	// Whole instances get dropped against the frustum using the bounds of the mesh's root node
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const SceneMesh& mesh = meshes[m];
+
+		visibleStart[m] = visible.size();
+
+		if (mesh.instances.size() == 1 || mesh.obj->bsp.nodes.empty())
+		{
+			continue;
+		}
+
+		for (size_t i = 0; i < mesh.instances.size(); i++)
+		{
+			glm::mat4 world = model * mesh.instances[i];
+			glm::mat4 mvp = viewProj * world;
+			BspFrustum frustum(&mvp[0][0]);
+
+			if (mesh.obj->frustumCull && frustum.Test(mesh.obj->bsp.nodes[0].bounds) == BSP_OUTSIDE)
+			{
+				instancesCulled++;
+				continue;
+			}
+
+			visible.push_back(mesh.instances[i]);
+		}
+	}
+
+	visibleStart[meshes.size()] = visible.size();
+
+	// One upload for every mesh's instances, each mesh then pointing at its own slice
+	if (!visible.empty())
+	{
+		if (!instanceVBO)
+		{
+			glGenBuffers(1, &instanceVBO);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+		if (visible.size() > instanceCapacity)
+		{
+			instanceCapacity = visible.size() * 2;
+			glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+		}
+
+		glBufferSubData(GL_ARRAY_BUFFER, 0, visible.size() * sizeof(glm::mat4), visible.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	glBindVertexArray(buffer.VAO);
+
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const SceneMesh& mesh = meshes[m];
+		AtariObj* obj = mesh.obj;
+		const MeshSlot& slot = obj->slot;
+		bool lit = obj->showLighting && !obj->bsp.vertLight.empty();
+
+		if (mesh.instances.size() == 1)
+		{
+			// Culling happens in object space, so pull the camera back through the model transform
+			glm::mat4 world = model * mesh.instances[0];
+			glm::mat4 mvp = viewProj * world;
+			glm::mat4 invModelView = glm::inverse(view * world);
+			glm::vec3 eye = glm::vec3(invModelView[3].x, invModelView[3].y, invModelView[3].z);
+
+			{
+				TRACE_SCOPE("Cull");
+				obj->Cull(mvp, eye);
+			}
+
+			const std::vector<BspRange>& ranges = obj->VisibleRanges();
+
+			if (!drawCounts.empty() && (world != batchWorld || lit != batchLit))
+			{
+				Flush(shader, transformLoc);
+			}
+
+			batchWorld = world;
+			batchLit = lit;
+
+			int readyTris = slot.indicesReady / 3;
+
+			// Indices are local to each mesh, the base vertex finds its verts in the shared buffer
+			for (size_t i = 0; i < ranges.size(); i++)
+			{
+				int triCount = std::min(ranges[i].triCount, readyTris - ranges[i].firstTri);
+
+				if (triCount <= 0)
+				{
+					continue;
+				}
+
+				drawCounts.push_back(triCount * 3);
+				trisSubmitted += triCount;
+				drawOffsets.push_back((const void*)((slot.firstIndex + (size_t)ranges[i].firstTri * 3) * sizeof(unsigned int)));
+				drawBaseVertices.push_back(slot.baseVertex);
+			}
+
+			instancesDrawn++;
+			continue;
+		}
+
+		int count = (int)(visibleStart[m + 1] - visibleStart[m]);
+
+		if (count > 0 && slot.indicesReady >= 3)
+		{
+			Flush(shader, transformLoc);
+
+			SetDrawState(lit, true, visibleStart[m] * sizeof(glm::mat4));
+			shader.Set(transformLoc, model);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, slot.indicesReady / 3 * 3, GL_UNSIGNED_INT,
+				(void*)(slot.firstIndex * sizeof(unsigned int)), count, slot.baseVertex);
+
+			instancesDrawn += count;
+			trisSubmitted += (long long)count * (slot.indicesReady / 3);
+			drawCalls++;
+		}
+	}
+
+	Flush(shader, transformLoc);
+	glBindVertexArray(0);
+}
+
+void Scene::Flush(const Shader& shader, int transformLoc)
+{
+	if (drawCounts.empty())
+	{
+		return;
+	}
+
+	SetDrawState(batchLit, false, 0);
+	shader.Set(transformLoc, batchWorld);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(),
+		(int)drawCounts.size(), drawBaseVertices.data());
+
+	drawCalls++;
+	drawCounts.clear();
+	drawOffsets.clear();
+	drawBaseVertices.clear();
+}
+
+void Scene::SetDrawState(bool lit, bool instanced, size_t instanceOffset)
+{
+	// Lit models draw solid, otherwise it's wireframe with the light attribute held at full
+	if (lit)
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glEnable(GL_DEPTH_TEST);
+		glEnableVertexAttribArray(1);
+	}
+	else
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		glDisable(GL_DEPTH_TEST);
+		glDisableVertexAttribArray(1);
+		glVertexAttrib1f(1, 1.0f);
+	}
+
+	// One mat4 per instance spread over four vec4 attributes. Without instancing the transform
+	// comes in through the uniform and the instance matrix is held at identity.
+	for (int i = 0; i < 4; i++)
+	{
+		if (instanced)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			glEnableVertexAttribArray(INSTANCE_ATTRIB + i);
+			glVertexAttribPointer(INSTANCE_ATTRIB + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(instanceOffset + sizeof(float) * 4 * i));
+			glVertexAttribDivisor(INSTANCE_ATTRIB + i, 1);
+		}
+		else
+		{
+			glDisableVertexAttribArray(INSTANCE_ATTRIB + i);
+			glVertexAttrib4f(INSTANCE_ATTRIB + i, i == 0, i == 1, i == 2, i == 3);
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
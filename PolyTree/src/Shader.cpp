@@ -1,14 +1,105 @@
 #include "Shader.h"
 
 #include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/gtc/type_ptr.hpp>
 
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
+// glad is generated for 4.0, so ARB_get_program_binary gets loaded by hand
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT_ 0x8257
+#define GL_PROGRAM_BINARY_LENGTH_ 0x8741
+
+typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+#define CACHE_MAGIC 0x50544243	// "PTBC"
+#define CACHE_MAX_BYTES (64u << 20)
+
+#define WATCH_INTERVAL_MS 250
+
+static GetProgramBinaryProc getProgramBinary = NULL;
+static ProgramBinaryProc programBinary = NULL;
+static ProgramParameteriProc programParameteri = NULL;
+
+static bool LoadBinaryFunctions()
+{
+	static bool tried = false;
+
+	if (!tried)
+	{
+		tried = true;
+
+		if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1) || glfwExtensionSupported("GL_ARB_get_program_binary"))
+		{
+			getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+			programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+			programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+		}
+	}
+
+	return getProgramBinary && programBinary;
+}
+
+static time_t ModifiedTime(const char* path)
+{
+	struct stat info;
+
+	return stat(path, &info) == 0 ? info.st_mtime : 0;
+}
+
+static uint64_t Hash(uint64_t h, const char* s)
+{
+	// FNV-1a
+	for (; s && *s; s++)
+	{
+		h = (h ^ (unsigned char)*s) * 0x100000001B3ull;
+	}
+
+	return h;
+}
 
 Shader::Shader(const char* vPath, const char* fPath)
+{
+	vertexPath = vPath;
+	fragmentPath = fPath;
+	programId = -1;
+	errorLog[0] = '\0';
+
+	Load();
+
+	vertexTime = ModifiedTime(vPath);
+	fragmentTime = ModifiedTime(fPath);
+	watching = true;
+	changed = false;
+	watcher = std::thread(&Shader::Watch, this);
+}
+
+Shader::~Shader()
+{
+	{
+		std::lock_guard<std::mutex> lock(watchMutex);
+		watching = false;
+	}
+
+	watchStop.notify_all();
+	watcher.join();
+
+	if (programId != (unsigned int)-1)
+	{
+		glDeleteProgram(programId);
+	}
+}
+
+bool Shader::Load()
 {
 	std::ifstream file;
 	std::stringstream fStream;
@@ -16,25 +107,41 @@ Shader::Shader(const char* vPath, const char* fPath)
 	std::string fCodeString;
 	std::string vCodeString;
 
-	unsigned int vertexId, fragmentId;
+	unsigned int vertexId, fragmentId, program;
 	int success;
 
-	programId = -1;
-
 	try
 	{
-		file.open(vPath);
+		file.open(vertexPath);
 		vStream << file.rdbuf();
 		file.close();
 		vCodeString = vStream.str();
 		const char * vCode = (const char*)vCodeString.c_str();
 
-		file.open(fPath);
+		file.open(fragmentPath);
 		fStream << file.rdbuf();
 		file.close();
 		fCodeString = fStream.str();
 		const char* fCode = (const char*)fCodeString.c_str();
 
+		// Binaries are only good for the exact sources on the exact driver that made them
+		uint64_t key = Hash(0xCBF29CE484222325ull, vCode);
+		key = Hash(key, fCode);
+		key = Hash(key, (const char*)glGetString(GL_VENDOR));
+		key = Hash(key, (const char*)glGetString(GL_RENDERER));
+		key = Hash(key, (const char*)glGetString(GL_VERSION));
+
+		// One cache file per pair of shaders, overwritten when either changes
+		char cachePath[64];
+		sprintf(cachePath, "shader-%08x.cache", (unsigned int)Hash(Hash(0xCBF29CE484222325ull, vertexPath.c_str()), fragmentPath.c_str()));
+
+		if (LoadBinary(cachePath, key, program))
+		{
+			Swap(program);
+			sprintf(errorLog, "Shaders loaded from cache.");
+			return true;
+		}
+
 		vertexId = glCreateShader(GL_VERTEX_SHADER);
 		glShaderSource(vertexId, 1, &vCode, NULL);
 		glCompileShader(vertexId);
@@ -45,7 +152,8 @@ Shader::Shader(const char* vPath, const char* fPath)
 		{
 			glGetShaderInfoLog(vertexId, 1024, NULL, errorLog);
 			std::cout << "Error compiling vertex shader\n" << errorLog << std::endl;
-			return;
+			glDeleteShader(vertexId);
+			return false;
 		}
 		
 		fragmentId = glCreateShader(GL_FRAGMENT_SHADER);
@@ -58,31 +166,88 @@ Shader::Shader(const char* vPath, const char* fPath)
 		{
 			glGetShaderInfoLog(fragmentId, 1024, NULL, errorLog);
 			std::cout << "Error compiling fragment shader\n" << errorLog << std::endl;
-			return;
+			glDeleteShader(vertexId);
+			glDeleteShader(fragmentId);
+			return false;
 		}
 
-		programId = glCreateProgram();
-		glAttachShader(programId, vertexId);
-		glAttachShader(programId, fragmentId);
-		glLinkProgram(programId);
+		program = glCreateProgram();
+		glAttachShader(program, vertexId);
+		glAttachShader(program, fragmentId);
+
+		if (LoadBinaryFunctions() && programParameteri)
+		{
+			programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT_, GL_TRUE);
+		}
+
+		glLinkProgram(program);
+
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
 
-		glGetShaderiv(programId, GL_LINK_STATUS, &success);
+		glDeleteShader(vertexId);
+		glDeleteShader(fragmentId);
 
 		if (!success)
 		{
-			glGetProgramInfoLog(programId, 1024, NULL, errorLog);
+			glGetProgramInfoLog(program, 1024, NULL, errorLog);
 			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << errorLog << std::endl;
-			return;
+			glDeleteProgram(program);
+			return false;
 		}
 
-		glDeleteShader(vertexId);
-		glDeleteShader(fragmentId);
+		Swap(program);
+		SaveBinary(cachePath, key);
 
 		sprintf(errorLog, "Shaders compiled successfully.");
 	}
 	catch (std::ifstream::failure e)
 	{
 		std::cout << "Error reading shader file" << std::endl;
+		sprintf(errorLog, "Error reading shader file.");
+		return false;
+	}
+
+	return true;
+}
+
+void Shader::Swap(unsigned int program)
+{
+	if (programId != (unsigned int)-1)
+	{
+		glDeleteProgram(programId);
+	}
+
+	programId = program;
+	uniforms.clear();
+	Reflect();
+}
+
+bool Shader::Reload()
+{
+	if (!changed.exchange(false))
+	{
+		return false;
+	}
+
+	return Load();
+}
+
+void Shader::Watch()
+{
+	std::unique_lock<std::mutex> lock(watchMutex);
+
+	// Polling a couple of files a few times a second costs nothing, and works the same everywhere
+	while (!watchStop.wait_for(lock, std::chrono::milliseconds(WATCH_INTERVAL_MS), [this]() { return !watching; }))
+	{
+		time_t v = ModifiedTime(vertexPath.c_str());
+		time_t f = ModifiedTime(fragmentPath.c_str());
+
+		if (v != vertexTime || f != fragmentTime)
+		{
+			vertexTime = v;
+			fragmentTime = f;
+			changed = true;
+		}
 	}
 }
 
@@ -91,3 +256,178 @@ void Shader::Use()
 	glUseProgram(programId);
 }
 
+bool Shader::LoadBinary(const char* path, uint64_t key, unsigned int& program)
+{
+	FILE* f;
+	uint32_t header[4];
+	uint64_t fileKey;
+	std::vector<char> binary;
+	int success;
+
+	if (!LoadBinaryFunctions() || !(f = fopen(path, "rb")))
+	{
+		return false;
+	}
+
+	// magic, format, length, then the key and the binary itself
+	bool ok = fread(header, sizeof(uint32_t), 3, f) == 3 && fread(&fileKey, sizeof(fileKey), 1, f) == 1 &&
+		header[0] == CACHE_MAGIC && fileKey == key && header[2] < CACHE_MAX_BYTES;
+
+	if (ok)
+	{
+		binary.resize(header[2]);
+		ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+	}
+
+	fclose(f);
+
+	if (!ok)
+	{
+		return false;
+	}
+
+	program = glCreateProgram();
+	programBinary(program, header[1], binary.data(), (GLsizei)binary.size());
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+	// Drivers can turn down their own binaries after an update, in which case we compile as usual
+	if (!success)
+	{
+		glDeleteProgram(program);
+		return false;
+	}
+
+	return true;
+}
+
+void Shader::SaveBinary(const char* path, uint64_t key) const
+{
+	int length = 0;
+	unsigned int format;
+	std::vector<char> binary;
+	FILE* f;
+
+	if (!LoadBinaryFunctions())
+	{
+		return;
+	}
+
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH_, &length);
+
+	if (length <= 0)
+	{
+		return;
+	}
+
+	binary.resize(length);
+	getProgramBinary(programId, length, &length, &format, binary.data());
+
+	if (!(f = fopen(path, "wb")))
+	{
+		return;
+	}
+
+	uint32_t header[3] = { CACHE_MAGIC, format, (uint32_t)length };
+
+	fwrite(header, sizeof(uint32_t), 3, f);
+	fwrite(&key, sizeof(key), 1, f);
+	fwrite(binary.data(), 1, length, f);
+	fclose(f);
+}
+
+void Shader::Reflect()
+{
+	int count = 0;
+	char name[256];
+
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &count);
+
+	for (int i = 0; i < count; i++)
+	{
+		int size;
+		unsigned int type;
+
+		glGetActiveUniform(programId, i, sizeof(name), NULL, &size, &type, name);
+
+		// Members of uniform blocks don't have locations
+		int location = glGetUniformLocation(programId, name);
+
+		if (location < 0)
+		{
+			continue;
+		}
+
+		// Arrays come back as name[0], but get asked for by their plain name too
+		std::string key = name;
+		size_t bracket = key.find('[');
+
+		uniforms[key] = location;
+
+		if (bracket != std::string::npos)
+		{
+			uniforms[key.substr(0, bracket)] = location;
+		}
+	}
+
+	unsigned int camera = glGetUniformBlockIndex(programId, "Camera");
+
+	if (camera != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(programId, camera, SHADER_CAMERA_BINDING);
+	}
+}
+
+int Shader::Uniform(const char* name) const
+{
+	std::unordered_map<std::string, int>::const_iterator it = uniforms.find(name);
+
+	return it == uniforms.end() ? -1 : it->second;
+}
+
+void Shader::Set(int location, int v) const
+{
+	glUniform1i(location, v);
+}
+
+void Shader::Set(int location, float v) const
+{
+	glUniform1f(location, v);
+}
+
+void Shader::Set(int location, const glm::vec3& v) const
+{
+	glUniform3fv(location, 1, glm::value_ptr(v));
+}
+
+void Shader::Set(int location, const glm::vec4& v) const
+{
+	glUniform4fv(location, 1, glm::value_ptr(v));
+}
+
+void Shader::Set(int location, const glm::mat4& m) const
+{
+	glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(m));
+}
+
+UniformBlock::UniformBlock(int blockSize, unsigned int binding)
+{
+	size = blockSize;
+
+	glGenBuffers(1, &bufferId);
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferId);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, bufferId);
+}
+
+UniformBlock::~UniformBlock()
+{
+	glDeleteBuffers(1, &bufferId);
+}
+
+void UniformBlock::Update(const void* data)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferId);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
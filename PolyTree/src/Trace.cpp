@@ -0,0 +1,252 @@
+#include "Trace.h"
+
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define TRACE_BLOCK_EVENTS 4096
+#define TRACE_MAX_BLOCKS (TRACE_MAX_EVENTS / TRACE_BLOCK_EVENTS)
+
+struct TraceEvent
+{
+	const char* name;
+	uint64_t start, end;
+};
+
+// Only the owning thread writes to a buffer, publishing each event through count so Save can
+// read alongside it without taking a lock. Blocks are allocated as needed and kept for the next
+// recording. Buffers outlive their threads and get handed on to new ones, so all the short lived
+// threads ParallelFor starts end up sharing a few rows rather than having one each.
+struct TraceBuffer
+{
+	int tid;
+	std::atomic<const char*> name;
+	std::atomic<uint32_t> session;
+	std::atomic<int> count;
+	std::atomic<int> dropped;
+	TraceEvent* blocks[TRACE_MAX_BLOCKS];
+};
+
+struct TraceThread
+{
+	TraceBuffer* buffer;
+
+	TraceThread() : buffer(NULL) {}
+	~TraceThread();
+};
+
+std::atomic<bool> Trace::recording(false);
+
+static std::mutex buffersMutex;
+static std::vector<TraceBuffer*> buffers, freeBuffers;
+static std::atomic<uint32_t> session(0);
+
+// Where the counter and the clock were at Start, to turn ticks into microseconds afterwards
+static uint64_t startTicks;
+static std::chrono::steady_clock::time_point startTime;
+
+static thread_local TraceThread traceThread;
+
+TraceThread::~TraceThread()
+{
+	if (buffer)
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		freeBuffers.push_back(buffer);
+	}
+}
+
+static TraceBuffer* LocalBuffer()
+{
+	if (traceThread.buffer)
+	{
+		return traceThread.buffer;
+	}
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	if (!freeBuffers.empty())
+	{
+		traceThread.buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+		return traceThread.buffer;
+	}
+
+	TraceBuffer* b = new TraceBuffer();
+	b->tid = (int)buffers.size() + 1;
+	b->name = NULL;
+	b->session = session.load() - 1;
+	b->count = 0;
+	b->dropped = 0;
+
+	for (int i = 0; i < TRACE_MAX_BLOCKS; i++)
+	{
+		b->blocks[i] = NULL;
+	}
+
+	buffers.push_back(b);
+	traceThread.buffer = b;
+	return b;
+}
+
+static std::string Escape(const char* s)
+{
+	std::string out;
+
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+		{
+			out += '\\';
+		}
+
+		out += *s;
+	}
+
+	return out;
+}
+
+void Trace::Start()
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	// Buffers notice the new session and empty themselves the next time their thread records
+	session++;
+	startTime = std::chrono::steady_clock::now();
+	startTicks = Now();
+	recording = true;
+}
+
+void Trace::Stop()
+{
+	recording = false;
+}
+
+void Trace::SetThreadName(const char* name)
+{
+	LocalBuffer()->name = name;
+}
+
+void Trace::Record(const char* name, uint64_t start, uint64_t end)
+{
+	TraceBuffer* b = LocalBuffer();
+	uint32_t current = session.load(std::memory_order_relaxed);
+
+	if (b->session.load(std::memory_order_relaxed) != current)
+	{
+		b->count.store(0, std::memory_order_relaxed);
+		b->dropped.store(0, std::memory_order_relaxed);
+		b->session.store(current, std::memory_order_release);
+	}
+
+	int n = b->count.load(std::memory_order_relaxed);
+
+	if (n >= TRACE_MAX_EVENTS)
+	{
+		b->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	TraceEvent*& block = b->blocks[n / TRACE_BLOCK_EVENTS];
+
+	if (!block)
+	{
+		block = new TraceEvent[TRACE_BLOCK_EVENTS];
+	}
+
+	TraceEvent& e = block[n % TRACE_BLOCK_EVENTS];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+
+	b->count.store(n + 1, std::memory_order_release);
+}
+
+long long Trace::EventCount()
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	uint32_t current = session.load();
+	long long total = 0;
+
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		if (buffers[i]->session.load(std::memory_order_acquire) == current)
+		{
+			total += buffers[i]->count.load(std::memory_order_acquire);
+		}
+	}
+
+	return total;
+}
+
+long long Trace::DroppedCount()
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	uint32_t current = session.load();
+	long long total = 0;
+
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		if (buffers[i]->session.load(std::memory_order_acquire) == current)
+		{
+			total += buffers[i]->dropped.load(std::memory_order_relaxed);
+		}
+	}
+
+	return total;
+}
+
+bool Trace::Save(const char* filename)
+{
+	FILE* f = fopen(filename, "w");
+
+	if (!f)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	uint32_t current = session.load();
+
+	// The counter rate isn't something the CPU will tell us, so measure it over the recording
+	double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+	double ticksPerMicro = elapsed > 0.0 ? (Now() - startTicks) / elapsed : 1.0;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"PolyTree\"}}");
+
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		TraceBuffer* b = buffers[i];
+		const char* name = b->name.load();
+		int count = b->session.load(std::memory_order_acquire) == current ? b->count.load(std::memory_order_acquire) : 0;
+
+		if (!count)
+		{
+			continue;
+		}
+
+		fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+			b->tid, name ? Escape(name).c_str() : "Thread");
+		fprintf(f, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"sort_index\":%i}}", b->tid, b->tid);
+
+		for (int j = 0; j < count; j++)
+		{
+			const TraceEvent& e = b->blocks[j / TRACE_BLOCK_EVENTS][j % TRACE_BLOCK_EVENTS];
+
+			// Scopes left open across a Start begin before it, so pin them to the start
+			double ts = e.start > startTicks ? (e.start - startTicks) / ticksPerMicro : 0.0;
+			double dur = e.end > e.start ? (e.end - e.start) / ticksPerMicro : 0.0;
+
+			fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%i}",
+				Escape(e.name).c_str(), ts, dur, b->tid);
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
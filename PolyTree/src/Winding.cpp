@@ -0,0 +1,156 @@
+#include "Winding.h"
+
+#include <math.h>
+
+double PlaneDist(const VisPlane& p, const VisPoint& v)
+{
+	return p.x * v.x + p.y * v.y + p.z * v.z - p.d;
+}
+
+VisPlane FlipPlane(const VisPlane& p)
+{
+	VisPlane f = { -p.x, -p.y, -p.z, -p.d };
+	return f;
+}
+
+VisPlane ToVisPlane(const BspPlane& p)
+{
+	VisPlane v = { p.nx / 65536.0, p.ny / 65536.0, p.nz / 65536.0, p.d / 65536.0 };
+	double len = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+
+	// Normals were rounded to 16.16, so tidy them back up to unit length
+	v.x /= len;
+	v.y /= len;
+	v.z /= len;
+	v.d /= len;
+
+	return v;
+}
+
+VisWinding BaseWinding(const VisPlane& p, double size)
+{
+	VisPoint up = { 0.0, 0.0, 1.0 };
+
+	if (fabs(p.z) > fabs(p.x) && fabs(p.z) > fabs(p.y))
+	{
+		up.x = 1.0;
+		up.z = 0.0;
+	}
+
+	double dot = up.x * p.x + up.y * p.y + up.z * p.z;
+	up.x -= p.x * dot;
+	up.y -= p.y * dot;
+	up.z -= p.z * dot;
+
+	double len = sqrt(up.x * up.x + up.y * up.y + up.z * up.z);
+	up.x *= size / len;
+	up.y *= size / len;
+	up.z *= size / len;
+
+	VisPoint right = { up.y * p.z - up.z * p.y, up.z * p.x - up.x * p.z, up.x * p.y - up.y * p.x };
+	VisPoint org = { p.x * p.d, p.y * p.d, p.z * p.d };
+	VisWinding w(4);
+
+	for (int i = 0; i < 4; i++)
+	{
+		double r = (i == 0 || i == 3) ? -1.0 : 1.0;
+		double u = (i < 2) ? 1.0 : -1.0;
+
+		w[i].x = org.x + right.x * r + up.x * u;
+		w[i].y = org.y + right.y * r + up.y * u;
+		w[i].z = org.z + right.z * r + up.z * u;
+	}
+
+	return w;
+}
+
+void SplitWinding(const VisWinding& in, const VisPlane& p, VisWinding& front, VisWinding& back)
+{
+	size_t count = in.size();
+	std::vector<double> dists(count);
+	int pos = 0, neg = 0;
+
+	front.clear();
+	back.clear();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		dists[i] = PlaneDist(p, in[i]);
+		pos += dists[i] > VIS_EPSILON;
+		neg += dists[i] < -VIS_EPSILON;
+	}
+
+	if (!neg)
+	{
+		front = in;
+		return;
+	}
+
+	if (!pos)
+	{
+		back = in;
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const VisPoint& a = in[i];
+		const VisPoint& b = in[(i + 1) % count];
+		double da = dists[i], db = dists[(i + 1) % count];
+
+		if (da >= -VIS_EPSILON)
+		{
+			front.push_back(a);
+		}
+
+		if (da <= VIS_EPSILON)
+		{
+			back.push_back(a);
+		}
+
+		if ((da > VIS_EPSILON && db < -VIS_EPSILON) || (da < -VIS_EPSILON && db > VIS_EPSILON))
+		{
+			double t = da / (da - db);
+			VisPoint mid = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t };
+
+			front.push_back(mid);
+			back.push_back(mid);
+		}
+	}
+
+	if (front.size() < 3)
+	{
+		front.clear();
+	}
+
+	if (back.size() < 3)
+	{
+		back.clear();
+	}
+}
+
+bool ChopWinding(VisWinding& w, const VisPlane& p)
+{
+	VisWinding front, back;
+	bool anyFront = false;
+
+	for (size_t i = 0; i < w.size(); i++)
+	{
+		if (PlaneDist(p, w[i]) > VIS_EPSILON)
+		{
+			anyFront = true;
+			break;
+		}
+	}
+
+	if (!anyFront)
+	{
+		w.clear();
+		return false;
+	}
+
+	SplitWinding(w, p, front, back);
+	w.swap(front);
+
+	return !w.empty();
+}
@@ -74,6 +74,7 @@
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include <stdio.h>
+#include <string.h>     // memcpy
 #if defined(_MSC_VER) && _MSC_VER <= 1500 // MSVC 2008 or earlier
 #include <stddef.h>     // intptr_t
 #else
@@ -135,6 +136,7 @@ static GLuint       g_ShaderHandle = 0, g_VertHandle = 0, g_FragHandle = 0;
 static GLint        g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;                                // Uniforms location
 static GLuint       g_AttribLocationVtxPos = 0, g_AttribLocationVtxUV = 0, g_AttribLocationVtxColor = 0; // Vertex attributes location
 static unsigned int g_VboHandle = 0, g_ElementsHandle = 0;
+static GLsizeiptr   g_VboSize = 0, g_ElementsSize = 0;      // Allocated sizes, the buffers only get reallocated when a frame outgrows them
 
 // Functions
 bool    ImGui_ImplOpenGL3_Init(const char* glsl_version)
@@ -278,6 +280,60 @@ static void ImGui_ImplOpenGL3_SetupRenderState(ImDrawData* draw_data, int fb_wid
     glVertexAttribPointer(g_AttribLocationVtxColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof(ImDrawVert), (GLvoid*)IM_OFFSETOF(ImDrawVert, col));
 }
 
+#if IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET
+// Copies every command list into the vertex/index buffers bound by ImGui_ImplOpenGL3_SetupRenderState().
+// The buffers only get reallocated when a frame needs more room than any before it. Otherwise mapping with
+// GL_MAP_INVALIDATE_BUFFER_BIT orphans last frame's storage, so the copy never waits on draws still reading it.
+static void ImGui_ImplOpenGL3_UploadDrawData(ImDrawData* draw_data)
+{
+    GLsizeiptr vtx_size = (GLsizeiptr)draw_data->TotalVtxCount * (int)sizeof(ImDrawVert);
+    GLsizeiptr idx_size = (GLsizeiptr)draw_data->TotalIdxCount * (int)sizeof(ImDrawIdx);
+    if (vtx_size == 0 || idx_size == 0)
+        return;
+
+    if (vtx_size > g_VboSize)
+    {
+        g_VboSize = vtx_size + vtx_size / 2;
+        glBufferData(GL_ARRAY_BUFFER, g_VboSize, NULL, GL_STREAM_DRAW);
+    }
+    if (idx_size > g_ElementsSize)
+    {
+        g_ElementsSize = idx_size + idx_size / 2;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_ElementsSize, NULL, GL_STREAM_DRAW);
+    }
+
+    ImDrawVert* vtx_dst = (ImDrawVert*)glMapBufferRange(GL_ARRAY_BUFFER, 0, vtx_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    ImDrawIdx* idx_dst = (ImDrawIdx*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, idx_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    GLintptr vtx_offset = 0;
+    GLintptr idx_offset = 0;
+
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        GLsizeiptr list_vtx_size = (GLsizeiptr)cmd_list->VtxBuffer.Size * (int)sizeof(ImDrawVert);
+        GLsizeiptr list_idx_size = (GLsizeiptr)cmd_list->IdxBuffer.Size * (int)sizeof(ImDrawIdx);
+
+        // Drivers are allowed to refuse a mapping, in which case fall back to plain sub-data uploads
+        if (vtx_dst)
+            memcpy((char*)vtx_dst + vtx_offset, cmd_list->VtxBuffer.Data, list_vtx_size);
+        else
+            glBufferSubData(GL_ARRAY_BUFFER, vtx_offset, list_vtx_size, (const GLvoid*)cmd_list->VtxBuffer.Data);
+        if (idx_dst)
+            memcpy((char*)idx_dst + idx_offset, cmd_list->IdxBuffer.Data, list_idx_size);
+        else
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, idx_offset, list_idx_size, (const GLvoid*)cmd_list->IdxBuffer.Data);
+
+        vtx_offset += list_vtx_size;
+        idx_offset += list_idx_size;
+    }
+
+    if (vtx_dst)
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    if (idx_dst)
+        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+}
+#endif
+
 // OpenGL3 Render function.
 // (this used to be set in io.RenderDrawListsFn and called by ImGui::Render(), but you can now call this directly from your main loop)
 // Note that this implementation is little overcomplicated because we are saving/setting up/restoring every OpenGL state explicitly, in order to be able to run within any OpenGL engine that doesn't do so.
@@ -330,14 +386,28 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
     ImVec2 clip_off = draw_data->DisplayPos;         // (0,0) unless using multi-viewports
     ImVec2 clip_scale = draw_data->FramebufferScale; // (1,1) unless using retina display which are often (2,2)
 
+    // With base vertex support every command list goes up in one go at the start of the frame, each list drawing from its own
+    // offset into the shared buffers. Otherwise indices are relative to their own list, so each list is uploaded on its own.
+    bool merged_upload = false;
+#if IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET
+    merged_upload = g_GlVersion >= 320;
+    if (merged_upload)
+        ImGui_ImplOpenGL3_UploadDrawData(draw_data);
+#endif
+    int global_vtx_offset = 0;
+    int global_idx_offset = 0;
+
     // Render command lists
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
 
         // Upload vertex/index buffers
-        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * (int)sizeof(ImDrawVert), (const GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * (int)sizeof(ImDrawIdx), (const GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+        if (!merged_upload)
+        {
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * (int)sizeof(ImDrawVert), (const GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * (int)sizeof(ImDrawIdx), (const GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+        }
 
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
         {
@@ -369,13 +439,19 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
                     glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
 #if IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET
                     if (g_GlVersion >= 320)
-                        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx)), (GLint)pcmd->VtxOffset);
+                        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)((pcmd->IdxOffset + global_idx_offset) * sizeof(ImDrawIdx)), (GLint)(pcmd->VtxOffset + global_vtx_offset));
                     else
 #endif
                     glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx)));
                 }
             }
         }
+
+        if (merged_upload)
+        {
+            global_vtx_offset += cmd_list->VtxBuffer.Size;
+            global_idx_offset += cmd_list->IdxBuffer.Size;
+        }
     }
 
     // Destroy the temporary VAO
@@ -667,6 +743,7 @@ void    ImGui_ImplOpenGL3_DestroyDeviceObjects()
 {
     if (g_VboHandle)        { glDeleteBuffers(1, &g_VboHandle); g_VboHandle = 0; }
     if (g_ElementsHandle)   { glDeleteBuffers(1, &g_ElementsHandle); g_ElementsHandle = 0; }
+    g_VboSize = g_ElementsSize = 0;
     if (g_ShaderHandle && g_VertHandle) { glDetachShader(g_ShaderHandle, g_VertHandle); }
     if (g_ShaderHandle && g_FragHandle) { glDetachShader(g_ShaderHandle, g_FragHandle); }
     if (g_VertHandle)       { glDeleteShader(g_VertHandle); g_VertHandle = 0; }
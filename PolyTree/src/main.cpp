@@ -14,10 +14,18 @@
 
 #include "ImGuiFileBrowser.h"
 
+#include "AssetIndex.h"
 #include "AtariObj.h"
+#include "BspInspector.h"
+#include "ModelLoader.h"
+#include "ObjInfoCache.h"
+#include "PerfHud.h"
+#include "Scene.h"
 #include "Shader.h"
+#include "Trace.h"
 
 #define OPEN_FILE "Open File"
+#define EXPORT_FILE "Export BSP"
 
 void fbSizeCallback(GLFWwindow* window, int width, int height)
 {
@@ -30,6 +38,33 @@ void processInput(GLFWwindow* window)
         glfwSetWindowShouldClose(window, true);
 }
 
+void objInfoTooltip(ObjInfoCache* cache, const std::string& path)
+{
+    const ObjInfo* info = cache->Get(path);
+
+    ImGui::BeginTooltip();
+
+    if (!info)
+    {
+        ImGui::Text("Scanning...");
+    }
+    else
+    {
+        ImGui::Text("%i verts, %i faces (%i tris)", info->vertCount, info->faceCount, info->triCount);
+        ImGui::Text("Min %.2f %.2f %.2f", info->boundsMin[0], info->boundsMin[1], info->boundsMin[2]);
+        ImGui::Text("Max %.2f %.2f %.2f", info->boundsMax[0], info->boundsMax[1], info->boundsMax[2]);
+
+        unsigned int thumb = cache->Thumbnail(path);
+
+        if (thumb)
+        {
+            ImGui::Image((ImTextureID)(intptr_t)thumb, ImVec2(OBJ_THUMB_SIZE * 2, OBJ_THUMB_SIZE * 2));
+        }
+    }
+
+    ImGui::EndTooltip();
+}
+
 int main(int argc, char** argv)
 {
     glfwInit();
@@ -43,7 +78,9 @@ int main(int argc, char** argv)
     glm::mat4 projection, view;
 
 
+    Scene* scene = NULL;
     AtariObj* obj = NULL;
+    int stressCount = 1000;
 
     GLFWwindow* window = glfwCreateWindow(800, 600, "PolyTree", NULL, NULL);
 
@@ -82,37 +119,84 @@ int main(int argc, char** argv)
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
 
+    Trace::SetThreadName("Main");
+
     bool showFileDialog = false;
+    bool showExportDialog = false;
+    bool recordTrace = false;
+    bool buildVis = false;
+    BspInspector inspector;
+    ModelLoader loader;
+
+    // Search over every OBJ under a root directory
+    AssetIndex assets;
+    bool showAssetSearch = false;
+    char assetRoot[1024] = "./";
+    char assetQuery[256] = "";
+    std::vector<int> assetResults;
+    int assetMatches = 0;
     imgui_addons::ImGuiFileBrowser fileDialog; // As a class member or globally
 
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
  
+    scene = new Scene();
     Shader* s = new Shader("vertex.glsl", "frag.glsl");
+    int transformLoc = s->Uniform("transform");
+
+    // Counts and thumbnails for OBJs shown in the browser and asset search
+    ObjInfoCache* objInfo = new ObjInfoCache("objinfo.cache");
+    fileDialog.file_tooltip = [objInfo](const std::string& path) { objInfoTooltip(objInfo, path); };
+
+    // Frame timing overlay, on the heap like the other GL owners so it goes before the context does
+    PerfHud* perf = new PerfHud();
+
+    // Camera and projection go to every program through the one buffer
+    UniformBlock* cameraBlock = new UniformBlock(sizeof(ShaderCamera), SHADER_CAMERA_BINDING);
+    ShaderCamera cameraData;
 
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
+        TRACE_SCOPE("Frame");
+        perf->BeginFrame();
+
         // Poll and handle events (inputs, window resize, etc.)
         // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to tell if dear imgui wants to use your inputs.
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
-        glfwPollEvents();
+        {
+            TRACE_SCOPE("Poll events");
+            glfwPollEvents();
+        }
 
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        // Object Info and the File menu work on whichever mesh is picked in the scene
+        obj = scene->Selected();
+
         if (ImGui::BeginMainMenuBar())
         {
             if (ImGui::BeginMenu("File"))
             {
-                if (ImGui::MenuItem("Open...", NULL))
+                if (ImGui::MenuItem("Open...", NULL, false, !loader.Busy()))
                 {
                     showFileDialog = true;
                 }
 
+                ImGui::MenuItem("Find Asset...", NULL, &showAssetSearch);
+
+                // Off by default, vis can take far longer than the rest of the load put together
+                ImGui::MenuItem("Build Vis on Load", NULL, &buildVis);
+
+                if (ImGui::MenuItem("Export BSP...", NULL, false, obj != NULL))
+                {
+                    showExportDialog = true;
+                }
+
                 if (ImGui::MenuItem("Quit", NULL))
                 {
 					glfwSetWindowShouldClose(window, true);
@@ -121,6 +205,32 @@ int main(int argc, char** argv)
                 ImGui::EndMenu();
             }
 
+            if (ImGui::BeginMenu("View"))
+            {
+                ImGui::MenuItem("BSP Inspector", NULL, &inspector.open, obj != NULL);
+                ImGui::MenuItem("Performance", NULL, &perf->open);
+
+                // Everything from here until it's switched off again goes to trace.json, for chrome://tracing or Perfetto
+                if (ImGui::MenuItem("Record Trace", NULL, &recordTrace))
+                {
+                    if (recordTrace)
+                    {
+                        Trace::Start();
+                    }
+                    else
+                    {
+                        Trace::Stop();
+
+                        if (!Trace::Save("trace.json"))
+                        {
+                            std::cout << "Failed to save trace.json" << std::endl;
+                        }
+                    }
+                }
+
+                ImGui::EndMenu();
+            }
+
             ImGui::EndMainMenuBar();
         }
 
@@ -136,12 +246,120 @@ int main(int argc, char** argv)
             strcpy(textBuffer, fileDialog.selected_path.c_str());
             showFileDialog = false;
 
-            if (obj)
+            loader.Start(textBuffer, fileDialog.selected_fn.c_str(), buildVis);
+        }
+
+        // The old results index into the old paths, so a new index is requeried whether or not
+        // the window is open to see it
+        if (assets.Update())
+        {
+            assetMatches = assets.Query(assetQuery, 10000, assetResults);
+        }
+
+        if (showAssetSearch)
+        {
+            ImGui::SetNextWindowSize(ImVec2(500, 400), ImGuiCond_FirstUseEver);
+            ImGui::Begin("Find Asset", &showAssetSearch);
+            ImGui::InputText("Root", assetRoot, sizeof(assetRoot));
+            ImGui::SameLine();
+
+            if (ImGui::Button("Index"))
+            {
+                assets.Build(assetRoot, ".obj");
+            }
+
+            if (assets.Building())
             {
-                delete obj;
+                ImGui::Text("Indexing... %i files\n", assets.FilesFound());
+            }
+            else
+            {
+                ImGui::Text("%i files indexed (%.2fs)\n", assets.PathCount(), assets.buildSeconds);
+            }
+
+            if (ImGui::InputText("Search", assetQuery, sizeof(assetQuery)))
+            {
+                assetMatches = assets.Query(assetQuery, 10000, assetResults);
             }
 
-            obj = new AtariObj(textBuffer);
+            ImGui::Text("%i matches (%.2f ms)\n", assetMatches, assets.querySeconds * 1000.0);
+            ImGui::BeginChild("Results", ImVec2(0, 0), true);
+
+            ImGuiListClipper clipper((int)assetResults.size());
+
+            while (clipper.Step())
+            {
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+                {
+                    const std::string& path = assets.Path(assetResults[i]);
+                    std::string fullPath = assets.Root() + path;
+                    bool open = ImGui::Selectable(path.c_str(), false, ImGuiSelectableFlags_AllowDoubleClick) && ImGui::IsMouseDoubleClicked(0);
+
+                    if (ImGui::IsItemHovered())
+                    {
+                        objInfoTooltip(objInfo, fullPath);
+                    }
+
+                    // Only the rows on screen get scanned
+                    const ObjInfo* info = objInfo->Get(fullPath);
+
+                    if (info)
+                    {
+                        ImGui::SameLine(ImGui::GetWindowContentRegionMax().x - 180);
+                        ImGui::TextDisabled("%8i verts %8i faces", info->vertCount, info->faceCount);
+                    }
+
+                    if (open && !loader.Busy())
+                    {
+                        size_t slash = path.find_last_of('/');
+
+                        snprintf(textBuffer, sizeof(textBuffer), "%s", fullPath.c_str());
+                        loader.Start(textBuffer, path.c_str() + (slash == std::string::npos ? 0 : slash + 1), buildVis);
+                    }
+                }
+            }
+
+            ImGui::EndChild();
+            ImGui::End();
+        }
+
+        // Models are loaded and compiled on a worker, only the upload happens here
+        AtariObj* loaded = loader.Poll();
+
+        if (loaded)
+        {
+            scene->AddMesh(loaded, loader.Name().c_str());
+        }
+
+        if (loader.Busy())
+        {
+            const BuildProgress& progress = loader.Progress();
+
+            ImGui::Begin("Loading", NULL, ImGuiWindowFlags_AlwaysAutoResize);
+            ImGui::Text("%s\n", loader.Name().c_str());
+            ImGui::ProgressBar(progress.Fraction(), ImVec2(300, 0), progress.Stage());
+
+            if (ImGui::Button("Cancel"))
+            {
+                loader.Cancel();
+            }
+
+            ImGui::End();
+        }
+
+        if (showExportDialog)
+        {
+            ImGui::OpenPopup(EXPORT_FILE);
+        }
+
+        if (fileDialog.showFileDialog(EXPORT_FILE, imgui_addons::ImGuiFileBrowser::DialogMode::SAVE, ImVec2(100, 100), ".bsp"))
+        {
+            showExportDialog = false;
+
+            if (obj && !obj->bsp.Export(fileDialog.selected_path.c_str()))
+            {
+                std::cout << "Failed to export " << fileDialog.selected_path << std::endl;
+            }
         }
 
         ImGui::Begin("Object Info", NULL);
@@ -150,14 +368,122 @@ int main(int argc, char** argv)
         if (obj)
         {
             ImGui::Text("Vert Count: %i\nFace Count: %i\n", obj->o.vertCount, obj->o.faceCount);
+            ImGui::Text("BSP Nodes: %i\nBSP Triangles: %i (%i splits)\n", (int)obj->bsp.nodes.size(), obj->bsp.TriCount(), obj->bsp.splitCount);
+
+            ImGui::Checkbox("Frustum Culling", &obj->frustumCull);
+            ImGui::SameLine();
+            ImGui::Checkbox("Backface Culling", &obj->backfaceCull);
+            ImGui::SameLine();
+            ImGui::Checkbox("PVS Culling", &obj->pvsCull);
+
+            ImGui::Text("BSP Build: %.2fs\n", obj->bsp.buildSeconds);
+            ImGui::Text("Leaves: %i empty (%i outside), %i solid\nCell Faces: %i (%.2fs)\nPortals: %i (%.2fs)\n",
+                obj->portals.emptyLeaves, obj->vis.outsideLeaves, obj->portals.solidLeaves, (int)obj->portals.cellFaces.size(), obj->portals.cellSeconds,
+                (int)obj->portals.portals.size(), obj->portals.portalSeconds);
+            ImGui::Text("PVS: %i bytes, %.1f leaves visible on average (%.2fs on %i threads)\nEye Leaf: %i%s\n",
+                (int)obj->bsp.visData.size(), obj->vis.averageVisible, obj->vis.visSeconds, obj->vis.threadCount,
+                obj->eyeLeaf, obj->eyeLeaf >= 0 && obj->bsp.leaves[obj->eyeLeaf].contents == BSP_SOLID ? " (solid)" : "");
+
+            const BspCullStats& stats = obj->cullStats;
+            ImGui::Text("Nodes Visited: %i\nNodes Culled: %i (PVS %i)\n", stats.nodesVisited, stats.nodesCulled, stats.nodesPvsCulled);
+            ImGui::Text("Triangles Drawn: %i\nFrustum Culled: %i\nBackface Culled: %i\nPVS Culled: %i\n", stats.trisDrawn, stats.trisFrustumCulled, stats.trisBackfaceCulled, stats.trisPvsCulled);
+
+            // Baked on the loader's worker, the result turning up once loader.Poll() hands it over
+            if (ImGui::Button("Bake Lighting") && !loader.Busy())
+            {
+                loader.Bake(obj, scene->meshes[scene->selected].name.c_str());
+            }
+
+            if (!obj->bsp.vertLight.empty())
+            {
+                ImGui::SameLine();
+                ImGui::Checkbox("Show Lighting", &obj->showLighting);
+
+                // Another bake would be writing these
+                if (!loader.Busy())
+                {
+                    ImGui::Text("Lighting: %lld rays in %.2fs on %i threads\n", obj->light.raysCast, obj->light.bakeSeconds, obj->light.threadCount);
+                }
+            }
+
+            if (ImGui::Button("Ray Benchmark"))
+            {
+                obj->collide.Benchmark(100000, obj->rayBench);
+            }
+
+            if (obj->rayBench.rays)
+            {
+                const BspRayBench& bench = obj->rayBench;
+                ImGui::Text("Rays: %i (%i hits)\nFloat: %.2f Mrays/s\nFixed: %.2f Mrays/s\nBatch: %.2f Mrays/s (%i threads)\n",
+                    bench.rays, bench.hits, bench.floatMRays, bench.fixedMRays, bench.batchMRays, obj->collide.threadCount);
+                ImGui::Text("Coherent: %.2f Mrays/s\nPacket: %.2f Mrays/s\n", bench.coherentMRays, bench.packetMRays);
+            }
         }
 
         ImGui::SliderFloat("Y Rotation", &rotSpeed, -.1f, .1f);
 
-        // ImGui::Text("Shader output:\n%s", s->errorLog);
+        ImGui::Text("Shader output:\n%s", s->errorLog);
+
+        ImGui::End();
+
+        if (obj)
+        {
+            inspector.Draw(obj->bsp);
+        }
+
+        ImGui::Begin("Scene", NULL);
+        ImGui::Text("Frame: %.2f ms (%.1f fps)\n", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Text("Instances: %i drawn, %i culled of %i\nDraw Calls: %i\n", scene->instancesDrawn, scene->instancesCulled, scene->InstanceCount(), scene->drawCalls);
+        ImGui::Text("Shared Buffers: %i verts, %i indices (%.1f MB)\n", (int)scene->buffer.VertsUsed(), (int)scene->buffer.IndicesUsed(), scene->buffer.Bytes() / (1024.0 * 1024.0));
+
+        // Submission rate on the CPU side, the copies themselves happen whenever the driver gets to them
+        MeshBuffer& meshBuffer = scene->buffer;
+        ImGui::Text("Upload: %.1f MB queued, %.2f MB this frame, %.0f MB/s\n", meshBuffer.PendingBytes() / (1024.0 * 1024.0),
+            meshBuffer.frameBytes / (1024.0 * 1024.0), meshBuffer.uploadSeconds > 0.0 ? meshBuffer.uploadedBytes / (1024.0 * 1024.0) / meshBuffer.uploadSeconds : 0.0);
+
+        int budgetMB = (int)(meshBuffer.uploadBudget >> 20);
+
+        if (ImGui::SliderInt("Upload Budget (MB/frame)", &budgetMB, 1, 256))
+        {
+            meshBuffer.uploadBudget = (size_t)budgetMB << 20;
+        }
+
+        for (int i = 0; i < (int)scene->meshes.size(); i++)
+        {
+            char label[300];
+            snprintf(label, sizeof(label), "%s (%i)##%i", scene->meshes[i].name.c_str(), (int)scene->meshes[i].instances.size(), i);
+
+            if (ImGui::Selectable(label, scene->selected == i))
+            {
+                scene->selected = i;
+            }
+        }
+
+        if (obj)
+        {
+            // Stress mode: lots of copies of the selected mesh to see where draw throughput runs out
+            ImGui::InputInt("Instances", &stressCount, 100, 1000);
+            stressCount = stressCount < 1 ? 1 : stressCount;
+
+            if (ImGui::Button("Spawn"))
+            {
+                scene->Stress(scene->selected, stressCount);
+            }
+
+            ImGui::SameLine();
+
+            // Not while the loader might be baking one of the meshes
+            if (ImGui::Button("Clear Scene") && !loader.Busy())
+            {
+                scene->Clear();
+                obj = NULL;
+            }
+        }
 
         ImGui::End();
 
+        perf->Draw();
+
         // Rendering
         ImGui::Render();
 
@@ -168,11 +494,21 @@ int main(int argc, char** argv)
         projection = glm::perspective(glm::radians(45.0f), (float)display_w / (float)display_h, 0.1f, 100.0f);
 
         glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
-        glClear(GL_COLOR_BUFFER_BIT);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        cameraData.camera = view;
+        cameraData.projection = projection;
+        cameraBlock->Update(&cameraData);
+
+        // Picks up edits to the shader files, keeping the old program if the new one doesn't build
+        if (s->Reload())
+        {
+            transformLoc = s->Uniform("transform");
+        }
 
         s->Use();
 
-        if (obj)
+        if (!scene->meshes.empty())
         {
             glm::mat4 trans = glm::mat4(1.0f);
             trans = glm::rotate(trans, glm::radians(30.0f), glm::vec3(1.0, 0.0, 0.0));
@@ -189,21 +525,41 @@ int main(int argc, char** argv)
                 rot += 360.0f;
             }
 
-            unsigned int transformLoc = glGetUniformLocation(s->programId, "transform");
-            glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(trans));
+            perf->BeginGpu(PERF_GPU_SCENE);
+            scene->Render(*s, transformLoc, trans, view, projection);
+            perf->EndGpu(PERF_GPU_SCENE);
+        }
 
-            unsigned int cameraLoc = glGetUniformLocation(s->programId, "camera");
-            glUniformMatrix4fv(cameraLoc, 1, GL_FALSE, glm::value_ptr(view));
+        {
+            TRACE_SCOPE("ImGui draw");
+            perf->BeginGpu(PERF_GPU_IMGUI);
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            perf->EndGpu(PERF_GPU_IMGUI);
+        }
 
-            unsigned int projLoc = glGetUniformLocation(s->programId, "projection");
-            glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        ImDrawData* drawData = ImGui::GetDrawData();
+        int imguiDraws = 0;
 
-            obj->Render();
+        for (int i = 0; i < drawData->CmdListsCount; i++)
+        {
+            imguiDraws += drawData->CmdLists[i]->CmdBuffer.Size;
         }
 
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (scene->meshes.empty())
+        {
+            perf->SetCounts(0, 0, imguiDraws, drawData->TotalIdxCount / 3);
+        }
+        else
+        {
+            perf->SetCounts(scene->drawCalls, scene->trisSubmitted, imguiDraws, drawData->TotalIdxCount / 3);
+        }
 
-        glfwSwapBuffers(window);
+        perf->EndFrame();
+
+        {
+            TRACE_SCOPE("Swap buffers");
+            glfwSwapBuffers(window);
+        }
     }
 
     // Cleanup
@@ -211,11 +567,14 @@ int main(int argc, char** argv)
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    if (obj)
-    {
-        delete obj;
-    }
+    // A bake still running would be reading a mesh the scene is about to free
+    loader.Stop();
+
+    delete perf;
+    delete objInfo;
+    delete scene;
 
+    delete cameraBlock;
     delete s;
 
     glfwDestroyWindow(window);
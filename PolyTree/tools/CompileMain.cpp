@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "BspPortals.h"
+#include "BspStream.h"
+#include "BspTree.h"
+#include "BspVis.h"
+#include "MemTrack.h"
+
+// polytree-compile: builds the BSP for an .obj and exports it for the Falcon
+//
+//   polytree-compile <in.obj> <out.bsp> [--mem=<MB>] [--tmp=<dir>] [--load] [--vis]
+//
+// The .obj is parsed on a thread of its own and streamed into the out of core build, which spills to
+// --tmp whatever doesn't fit in the --mem budget, 1GB by default. --load reads the whole file with
+// loadObj first instead, building in core unless there's a --mem.
+
+static void Usage()
+{
+	fprintf(stderr, "usage: polytree-compile <in.obj> <out.bsp> [--mem=<MB>] [--tmp=<dir>] [--load] [--vis]\n");
+}
+
+static bool StreamBuild(BspStreamBuilder& stream, BspTree& tree, BspTriSource& source, const char* path)
+{
+	if (!stream.Build(tree, source))
+	{
+		fprintf(stderr, "Failed to build %s, either it couldn't be read or there's no room in %s\n", path, stream.tmpDir.c_str());
+		return false;
+	}
+
+	if (!stream.trisRead)
+	{
+		fprintf(stderr, "No triangles in %s\n", path);
+		return false;
+	}
+
+	printf("Streamed %lld triangles: %i buckets (%i in core, %i forced), depth %i, %.1f MB spilled\n", stream.trisRead,
+		stream.buckets, stream.inCoreBuckets, stream.forcedBuckets, stream.maxDepth, stream.bytesSpilled / (1024.0 * 1024.0));
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	BspStreamBuilder stream;
+	long long memMB = 0;
+	bool load = false;
+	bool vis = false;
+
+	if (argc < 3)
+	{
+		Usage();
+		return 1;
+	}
+
+	for (int i = 3; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "--mem=", 6))
+		{
+			memMB = atoll(argv[i] + 6);
+		}
+		else if (!strncmp(argv[i], "--tmp=", 6))
+		{
+			stream.tmpDir = argv[i] + 6;
+		}
+		else if (!strcmp(argv[i], "--load"))
+		{
+			load = true;
+		}
+		else if (!strcmp(argv[i], "--vis"))
+		{
+			vis = true;
+		}
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	if (memMB < 0)
+	{
+		Usage();
+		return 1;
+	}
+
+	BspTree tree;
+
+	if (memMB > 0)
+	{
+		stream.memoryBudget = memMB * 1024 * 1024;
+	}
+
+	if (load)
+	{
+		std::string path = argv[1];
+		Obj o;
+
+		{
+			MemScope mem(MEM_LOADER);
+			o = loadObj(&path[0]);
+			MemTrack::Add(MEM_LOADER, ObjBytes(o));
+		}
+
+		if (!o.indexCount)
+		{
+			fprintf(stderr, "No triangles in %s\n", argv[1]);
+			return 1;
+		}
+
+		if (memMB > 0)
+		{
+			BspObjSource source(o, true);
+
+			if (!StreamBuild(stream, tree, source, argv[1]))
+			{
+				return 1;
+			}
+		}
+		else
+		{
+			tree.Build(o);
+
+			MemTrack::Sub(MEM_LOADER, ObjBytes(o));
+			free(o.verts);
+			free(o.indices);
+		}
+	}
+	else
+	{
+		BspObjStream reader;
+
+		if (!reader.Open(argv[1]))
+		{
+			fprintf(stderr, "Can't open %s\n", argv[1]);
+			return 1;
+		}
+
+		if (!StreamBuild(stream, tree, reader, argv[1]))
+		{
+			return 1;
+		}
+
+		printf("Read %.1f MB, %lld verts, %lld triangles in %.2fs, %.2fs of it waiting on the parser\n", reader.bytesRead / (1024.0 * 1024.0),
+			reader.vertCount.load(), reader.triCount.load(), stream.readSeconds, reader.waitSeconds);
+	}
+
+	printf("%i nodes, %i leaves, %i triangles, %i splits in %.2fs\n", (int)tree.nodes.size(), (int)tree.leaves.size(),
+		tree.TriCount(), tree.splitCount, tree.buildSeconds);
+
+	if (vis)
+	{
+		BspPortals portals;
+		BspVis flow;
+
+		portals.Build(tree);
+		flow.Build(tree, portals);
+
+		printf("Vis: %i leaves outside, %.1f leaves visible on average in %.2fs\n", flow.outsideLeaves, flow.averageVisible, flow.visSeconds);
+	}
+
+	if (!tree.Export(argv[2]))
+	{
+		fprintf(stderr, "Failed to write %s\n", argv[2]);
+		return 1;
+	}
+
+	MemTrack::Report(stdout);
+	return 0;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MemTrack.h"
+#include "MeshGen.h"
+
+// polytree-gen: writes a synthetic test mesh to an .obj file
+//
+//   polytree-gen <kind> <triangles> <file.obj> [--seed=<n>] [--size=<half width>] [--threads=<n>]
+
+static void Usage()
+{
+	fprintf(stderr, "usage: polytree-gen <kind> <triangles> <file.obj> [--seed=<n>] [--size=<half width>] [--threads=<n>]\n");
+	fprintf(stderr, "kinds:");
+
+	for (int i = 0; i < MESHGEN_KIND_COUNT; i++)
+	{
+		fprintf(stderr, " %s", MeshGen::KindName((MeshGenKind)i));
+	}
+
+	fprintf(stderr, "\ntriangles takes a k or M suffix, e.g. 100M\n");
+}
+
+static long long ParseCount(const char* s)
+{
+	char* end;
+	double count = strtod(s, &end);
+
+	if (*end == 'k' || *end == 'K')
+	{
+		count *= 1e3;
+	}
+	else if (*end == 'm' || *end == 'M')
+	{
+		count *= 1e6;
+	}
+
+	return (long long)count;
+}
+
+int main(int argc, char** argv)
+{
+	MeshGen gen;
+
+	if (argc < 4 || !MeshGen::FindKind(argv[1], gen.kind))
+	{
+		Usage();
+		return 1;
+	}
+
+	gen.triCount = ParseCount(argv[2]);
+
+	for (int i = 4; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "--seed=", 7))
+		{
+			gen.seed = (uint32_t)strtoul(argv[i] + 7, NULL, 10);
+		}
+		else if (!strncmp(argv[i], "--size=", 7))
+		{
+			gen.size = (float)atof(argv[i] + 7);
+		}
+		else if (!strncmp(argv[i], "--threads=", 10))
+		{
+			gen.threadCount = atoi(argv[i] + 10);
+		}
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	if (gen.triCount <= 0)
+	{
+		Usage();
+		return 1;
+	}
+
+	if (!gen.Write(argv[3]))
+	{
+		fprintf(stderr, "Failed to write %s\n", argv[3]);
+		return 1;
+	}
+
+	printf("%s: %lld verts, %lld triangles, %.1f MB in %.2fs (%.1f MB/s)\n", argv[3], gen.vertsMade, gen.trisMade,
+		gen.bytesWritten / (1024.0 * 1024.0), gen.seconds, gen.bytesWritten / (1024.0 * 1024.0) / (gen.seconds > 0.0 ? gen.seconds : 1.0));
+	printf("Peak memory: %.1f MB\n", MemTrack::TotalPeak() / (1024.0 * 1024.0));
+
+	return 0;
+}
@@ -1,14 +1,20 @@
 #version 330 core
 layout (location = 0) in vec3 aPos; // the position variable has attribute position 0
+layout (location = 1) in float aLight; // baked vertex lighting, 0 to 1
+layout (location = 2) in mat4 aInstance; // per-instance transform, takes locations 2 to 5
   
 out vec4 vertexColor; // specify a color output to the fragment shader
 
 uniform mat4 transform;
-uniform mat4 camera;
-uniform mat4 projection;
+
+layout (std140) uniform Camera
+{
+    mat4 camera;
+    mat4 projection;
+};
 
 void main()
 {
-    gl_Position = projection * camera * transform * vec4(aPos, 1.0);  // see how we directly give a vec3 to vec4's constructor
-    vertexColor = vec4(0.5, 0.0, 0.0, 1.0);     // set the output variable to a dark-red color
+    gl_Position = projection * camera * transform * aInstance * vec4(aPos, 1.0);  // see how we directly give a vec3 to vec4's constructor
+    vertexColor = vec4(vec3(1.0, 0.5, 0.2) * aLight, 1.0);
 }